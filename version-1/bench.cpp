@@ -0,0 +1,152 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <chrono>
+
+#include "moveGenerator.h"
+#include "position.h"
+#include "random.h"
+#include "learner.h"
+#include "search.h"
+#include "transposition.h"
+#include "bench.h"
+
+// Openings, middlegames and endgames, the total node count of a bench is a signature of the search
+const char* benchPositions[] = {
+    "lnsgkgsnl/1r5b1/ppppppppp/9/9/9/PPPPPPPPP/1B5R1/LNSGKGSNL b - 1",
+    "ln3g1nl/1r1s2k2/ppp1ppspp/4g1p2/3N5/2PP1B3/PP2PPPPP/2G4R1/L1S1KGSNL b Pb 1",
+    "2g2p1n1/2ns3g1/l1ppp2pl/ppg1krp2/1nPPsP1Pp/PP2PSP2/2B2GK1P/1B7/L1SR3NL b - 1",
+    "3g3nl/lr3b2s/ppnsgpp1p/1Pp2k1pP/4p2N1/2PpPP3/P1S3PP1/1B1G4R/LN2GKS1L b p 1",
+    "ln1g3nl/1r2g1sk1/p1spppbpp/2p3p2/1p7/2PP5/PPBSPPPPP/2GR2SK1/LN3G1NL b - 1",
+    "lnsgk1snl/4gr3/ppppp2pp/8+b/9/2P1+B4/PPNPP1PPP/4G2R1/L1S1KGSNL w 2Pp 1",
+    "ln1k4l/1sg1gr1s1/ppppp4/7+bp/2N+B1ppp1/2P1R4/PPNPG1PPP/2S6/L3KGSNL w 2p 1",
+    "ln1k2b2/2gg1s+R2/ps1p1+P2l/2p5p/3N1+bpp1/2PP5/PP2G1PPP/2S6/L1K2GSNL w NPr3p 1",
+    "lnk1p4/2gg1+B3/ps1p4l/2p5p/3N2p+B1/2P2n3/PP4PPP/3+rPK3/+r4GSNL w G2SPl4p 1",
+    "ln3g1+S+N/1r1s4B/ppp1ppkpp/9/3N1gp2/2PPP4/PP1G1PPPP/3R2S+l1/L1S1KG2+b b NPl 1",
+    "ln4+S1+N/1r1s4B/ppp1ppkg1/4P2pp/3N2g2/2PP5/PP1G1PG2/4R2+n1/L1S1K3+b b L5Psl 1",
+};
+
+// Searches every position to a fixed depth from a fresh state and reports the node count and speed
+void bench(int depth)
+{
+    const int savedMultiPV = multiPV;
+    multiPV = 1;
+    uint64_t totalNodes = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (const char* sfen : benchPositions)
+    {
+        Position pos;
+        pos.loadSFEN(sfen);
+        clearTranspositionTable();
+        clearSearchHistory();
+        stopSearch = false;
+        pondering = false;
+
+        SearchLimits limits;
+        limits.depth = depth;
+        Move ponderMove;
+        std::cout << "position sfen " << sfen << "\n";
+        const Move bestMove = think(pos, limits, ponderMove);
+        std::cout << "bestmove " << bestMove << "\n";
+        totalNodes += searchedNodes();
+    }
+    const auto end = std::chrono::steady_clock::now();
+    const uint64_t elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+    multiPV = savedMultiPV;
+
+    std::cout << "===========================\n";
+    std::cout << "Total time (ms) : " << elapsed << "\n";
+    std::cout << "Nodes searched  : " << totalNodes << "\n";
+    std::cout << "Nodes/second    : " << (elapsed > 0 ? totalNodes * 1000 / elapsed : 0) << std::endl;
+}
+
+// Positions in the regular format of the training files from random games out of the bench positions
+static std::vector<std::string> randomPositions(int count)
+{
+    std::vector<std::string> positions;
+    Position pos;
+    for (int game = 0; (int) positions.size() < count; game++)
+    {
+        pos.loadSFEN(benchPositions[game % (sizeof(benchPositions) / sizeof(benchPositions[0]))]);
+        for (int ply = 0; ply < 200 && (int) positions.size() < count; ply++)
+        {
+            moveList moves;
+            generateMoves(pos, moves);
+            if (moves.size == 0)
+            {
+                break;
+            }
+            Move move = moves.getMove(randomInteger() % moves.size);
+            pos.makeMove(move);
+            positions.push_back(pos.regularFormat());
+        }
+    }
+    return positions;
+}
+
+// Evaluates the positions of a training file, or of random games without one, with evaluateBatch() and with
+// evaluation() one at a time. Reports the speed of both and every position where they differ
+void evalBench(const std::string& file)
+{
+    std::vector<std::string> records;
+    if (file.empty())
+    {
+        records = randomPositions(EVAL_BENCH_POSITIONS);
+    }
+    else
+    {
+        std::ifstream input(file);
+        if (!input.is_open())
+        {
+            std::cout << "Cannot open " << file << std::endl;
+            return;
+        }
+        std::string line;
+        while (std::getline(input, line))
+        {
+            records.push_back(line);
+        }
+    }
+
+    // The positions go through in chunks, a position keeps a whole game history
+    const int CHUNK = 16384;
+    std::vector<Position> positions(CHUNK);
+    std::vector<double> batch(CHUNK);
+    uint64_t batchTime = 0, serialTime = 0, mismatches = 0;
+    for (size_t first = 0; first < records.size(); first += CHUNK)
+    {
+        const int count = (int) std::min<size_t>(CHUNK, records.size() - first);
+        for (int i = 0; i < count; i++)
+        {
+            std::istringstream record(records[first + i]);
+            std::string board;
+            int handOne, handTwo, side;
+            record >> board >> handOne >> handTwo >> side;
+            positions[i].loadRegularFormat(board, handOne, handTwo, side);
+        }
+        auto start = std::chrono::steady_clock::now();
+        evaluateBatch(positions.data(), count, batch.data());
+        auto end = std::chrono::steady_clock::now();
+        batchTime += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < count; i++)
+        {
+            if (evaluation(positions[i]) != batch[i])
+            {
+                mismatches++;
+                std::cout << "mismatch " << records[first + i] << "\n";
+            }
+        }
+        end = std::chrono::steady_clock::now();
+        serialTime += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    }
+
+    std::cout << "===========================\n";
+    std::cout << "Positions       : " << records.size() << "\n";
+    std::cout << "Mismatches      : " << mismatches << "\n";
+    std::cout << "Batch pos/s     : " << (batchTime > 0 ? records.size() * 1000000 / batchTime : 0) << "\n";
+    std::cout << "Serial pos/s    : " << (serialTime > 0 ? records.size() * 1000000 / serialTime : 0) << std::endl;
+}
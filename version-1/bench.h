@@ -0,0 +1,13 @@
+#ifndef BENCH_H_INCLUDED
+#define BENCH_H_INCLUDED
+
+#include <string>
+
+const int BENCH_DEPTH = 5;
+// Random positions of the evaluation bench when no training file is given
+const int EVAL_BENCH_POSITIONS = 1000000;
+
+void bench(int depth);
+void evalBench(const std::string& file);
+
+#endif // BENCH_H_INCLUDED
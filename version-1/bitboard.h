@@ -3,6 +3,10 @@
 
 // for 128 bit register
 #include <emmintrin.h>
+#ifdef __AVX2__
+// for the 256 bit register of BitboardPair
+#include <immintrin.h>
+#endif
 
 enum PieceType {
     KING                    = 0,
@@ -185,6 +189,25 @@ struct alignas(16) Bitboard
         return p[0] | p[1];
     }
 
+    // Bit of a square as 0 or 1
+    int bit(int square) const
+    {
+        return (int) (square < 63 ? p[0] >> square : p[1] >> (square - 63)) & 1;
+    }
+
+    // Squares 0 to 62 sit in the low word and 63 to 80 in the high word, the consecutive form closes the gap so
+    // square i is bit i of the 128 bits
+    void toConsecutive(uint64_t (&bits)[2]) const
+    {
+        bits[0] = p[0] | (p[1] << 63);
+        bits[1] = p[1] >> 1;
+    }
+
+    static Bitboard fromConsecutive(uint64_t low, uint64_t high)
+    {
+        return Bitboard(low & UINT64_C(0x7FFFFFFFFFFFFFFF), (low >> 63) | (high << 1));
+    }
+
     void removeLSB()
     {
         if (p[0] != 0)
@@ -457,4 +480,143 @@ inline Bitboard attackMap(int piece, int square, const Bitboard& empty, bool fir
     }
 }
 
+// Squares reached by every piece of a set taking one step of delta, steps off the side of the board are dropped
+inline Bitboard stepAttack(const Bitboard& pieces, int delta)
+{
+    // Column change of the step: -1, 0 or 1, the board wraps from one column to the next
+    const int column = (delta % 9 + 13) % 9 - 4;
+    const Bitboard valid = Bitboard(true) & ~(column == 1 ? columnMask[0] : column == -1 ? columnMask[8] : Bitboard(false));
+    uint64_t low, high;
+    if (delta > 0)
+    {
+        low  = pieces.p[0] << delta;
+        high = (pieces.p[1] << delta) | (pieces.p[0] >> (63 - delta));
+    }
+    else
+    {
+        low  = (pieces.p[0] >> -delta) | (pieces.p[1] << (63 + delta));
+        high = pieces.p[1] >> -delta;
+    }
+    return Bitboard(low & valid.p[0], high & valid.p[1]);
+}
+
+// The same bitboard for both players, indexed by player (1 for player one). Held in one 256 bit register with AVX2,
+// otherwise in two 128 bit registers
+struct alignas(32) BitboardPair
+{
+    union
+    {
+        uint64_t p[4];
+#ifdef __AVX2__
+        __m256i m;
+#else
+        __m128i m[2];
+#endif
+    };
+
+    BitboardPair()
+    {
+#ifdef __AVX2__
+        m = _mm256_setzero_si256();
+#else
+        m[0] = m[1] = _mm_setzero_si128();
+#endif
+    }
+
+    BitboardPair(const Bitboard& playerTwo, const Bitboard& playerOne)
+    {
+#ifdef __AVX2__
+        m = _mm256_inserti128_si256(_mm256_castsi128_si256(playerTwo.m), playerOne.m, 1);
+#else
+        m[0] = playerTwo.m;
+        m[1] = playerOne.m;
+#endif
+    }
+
+    Bitboard operator[](int player) const
+    {
+        return Bitboard(p[2 * player], p[2 * player + 1]);
+    }
+
+    BitboardPair operator&(const BitboardPair& rhs) const
+    {
+        BitboardPair result;
+#ifdef __AVX2__
+        result.m = _mm256_and_si256(m, rhs.m);
+#else
+        result.m[0] = _mm_and_si128(m[0], rhs.m[0]);
+        result.m[1] = _mm_and_si128(m[1], rhs.m[1]);
+#endif
+        return result;
+    }
+
+    BitboardPair operator|(const BitboardPair& rhs) const
+    {
+        BitboardPair result;
+#ifdef __AVX2__
+        result.m = _mm256_or_si256(m, rhs.m);
+#else
+        result.m[0] = _mm_or_si128(m[0], rhs.m[0]);
+        result.m[1] = _mm_or_si128(m[1], rhs.m[1]);
+#endif
+        return result;
+    }
+
+    BitboardPair operator^(const BitboardPair& rhs) const
+    {
+        BitboardPair result;
+#ifdef __AVX2__
+        result.m = _mm256_xor_si256(m, rhs.m);
+#else
+        result.m[0] = _mm_xor_si128(m[0], rhs.m[0]);
+        result.m[1] = _mm_xor_si128(m[1], rhs.m[1]);
+#endif
+        return result;
+    }
+
+    // The squares of this pair that are not in rhs
+    BitboardPair andNot(const BitboardPair& rhs) const
+    {
+        BitboardPair result;
+#ifdef __AVX2__
+        result.m = _mm256_andnot_si256(rhs.m, m);
+#else
+        result.m[0] = _mm_andnot_si128(rhs.m[0], m[0]);
+        result.m[1] = _mm_andnot_si128(rhs.m[1], m[1]);
+#endif
+        return result;
+    }
+
+    BitboardPair& operator&=(const BitboardPair& rhs) { return *this = *this & rhs; }
+    BitboardPair& operator|=(const BitboardPair& rhs) { return *this = *this | rhs; }
+    BitboardPair& operator^=(const BitboardPair& rhs) { return *this = *this ^ rhs; }
+
+    // Steps by delta for player one and by the mirrored -delta for player two, as stepAttack does for one player
+    BitboardPair step(int delta) const
+    {
+#ifdef __AVX2__
+        // Variable shifts of 64 or more give zero. The shifted half moves left or right by the step, and the
+        // swapped half carries the bits across the gap between square 62 in the low word and 63 in the high word
+        const int64_t d = (delta > 0 ? delta : -delta);
+        // Player one sits in the upper half and shifts left on a positive step, player two the other way
+        const __m256i oneLeft[4]  = {_mm256_setr_epi64x(64, 64, d, d), _mm256_setr_epi64x(d, d, 64, 64),
+                                     _mm256_setr_epi64x(63 - d, 64, 64, 64), _mm256_setr_epi64x(64, 64, 64, 63 - d)};
+        const __m256i oneRight[4] = {_mm256_setr_epi64x(d, d, 64, 64), _mm256_setr_epi64x(64, 64, d, d),
+                                     _mm256_setr_epi64x(64, 64, 63 - d, 64), _mm256_setr_epi64x(64, 63 - d, 64, 64)};
+        const __m256i* counts = (delta > 0 ? oneLeft : oneRight);
+        const __m256i swapped = _mm256_shuffle_epi32(m, _MM_SHUFFLE(1, 0, 3, 2));
+        BitboardPair result;
+        result.m = _mm256_or_si256(_mm256_or_si256(_mm256_sllv_epi64(m, counts[0]), _mm256_srlv_epi64(m, counts[1])),
+                                   _mm256_or_si256(_mm256_sllv_epi64(swapped, counts[2]), _mm256_srlv_epi64(swapped, counts[3])));
+        // Drop the squares past the board and the steps that wrap around a column
+        const int column = (delta % 9 + 13) % 9 - 4;
+        const Bitboard wrapOne = (column == 1 ? columnMask[0] : column == -1 ? columnMask[8] : Bitboard(false));
+        const Bitboard wrapTwo = (column == 1 ? columnMask[8] : column == -1 ? columnMask[0] : Bitboard(false));
+        return result & BitboardPair(Bitboard(true) & ~wrapTwo, Bitboard(true) & ~wrapOne);
+#else
+        return BitboardPair(stepAttack((*this)[0], -delta), stepAttack((*this)[1], delta));
+#endif
+    }
+};
+
 #endif // BITBOARD_H_INCLUDED
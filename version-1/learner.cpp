@@ -5,6 +5,14 @@
 #include <string>
 #include <sstream>
 #include <map>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <thread>
+#include <random>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 #include "bitboard.h"
 #include "moveGenerator.h"
@@ -39,6 +47,214 @@ double totalPositions = 0;
 
 double LL_2 = 0;
 
+// Fixed-point copies of the parameters used by the search, quantised from the trained doubles.
+// The material table holds piece value plus piece-square term per owner (1 for player one)
+int16_t materialFixed       [2][16][81];
+int16_t pieceInHandFixed    [7][19];
+// One padding row, the vector kernel gathers 32 bits at a time
+int16_t kikiKingSafetyFixed [290][4][4];
+// Bound on the king-safety term lazyEvaluate() assumes, measured by quantiseParameters()
+int kikiSwing = 0;
+
+// Largest king-safety term over random games from the initial position, with half of it again as margin. Depends
+// only on the parameters, never on the search or the working directory
+static int measureKikiSwing()
+{
+    int largest = 0;
+    int samples = 0;
+    Position pos;
+    // A fixed seed keeps the swing the same from run to run
+    std::mt19937 random(1);
+    while (samples < KIKI_SWING_SAMPLES)
+    {
+        pos.loadInitial();
+        for (int ply = 0; ply < 200 && samples < KIKI_SWING_SAMPLES; ply++)
+        {
+            moveList moves;
+            generateMoves(pos, moves);
+            if (moves.size == 0)
+            {
+                break;
+            }
+            Move move = moves.getMove(random() % moves.size);
+            pos.makeMove(move);
+            largest = std::max(largest, std::abs(kikiEvaluation(pos)));
+            samples++;
+        }
+    }
+    return largest * 3 / 2;
+}
+
+// Saturates instead of wrapping, a parameter beyond 4 log-odds keeps its sign
+static int16_t quantise(double value)
+{
+    return (int16_t) std::max<long>(INT16_MIN, std::min<long>(INT16_MAX, std::lround(value * EVAL_ONE)));
+}
+
+// Player two reads pieceSquareTable[piece][81 - square], which runs into the next row on square 0, the entry past the
+// table is read as 0
+static int mirroredSquare(int piece, int square)
+{
+    return 81 * piece + 81 - square;
+}
+
+static double mirroredSquareValue(int piece, int square)
+{
+    const int mirrored = mirroredSquare(piece, square);
+    return mirrored < 16 * 81 ? (&pieceSquareTable[0][0])[mirrored] : 0;
+}
+
+void quantiseParameters()
+{
+    for (int piece = 0; piece < 16; piece++)
+    {
+        for (int square = 0; square < 81; square++)
+        {
+            materialFixed[1][piece][square] =  quantise(pieceValue[piece] + pieceSquareTable[piece][square]);
+            materialFixed[0][piece][square] = -quantise(pieceValue[piece] + mirroredSquareValue(piece, square));
+        }
+    }
+
+    for (int i = 0; i < 7; i++)
+        for (int j = 0; j < 19; j++)
+            pieceInHandFixed[i][j] = quantise(pieceInHand[i][j]);
+
+    for (int i = 0; i < 289; i++)
+        for (int j = 0; j < 4; j++)
+            for (int k = 0; k < 4; k++)
+                kikiKingSafetyFixed[i][j][k] = quantise(kikiKingSafety[i][j][k]);
+    kikiSwing = measureKikiSwing();
+}
+
+// Material and piece-square term of one square, empty squares count as player two kings
+int materialTerm(const Position& pos, int square)
+{
+    return materialFixed[pos.pieceMaps[8] & squareMask[square] ? 1 : 0][pos.mailbox[square]][square];
+}
+
+// Hand term of one piece type of one player
+int handTerm(const Position& pos, bool player, int piece)
+{
+    int value = pieceInHandFixed[piece - 1][hand_count(pos.hand[player], piece)];
+    return (player ? value : -value);
+}
+
+// Material, piece-square and hand terms computed from scratch, the search keeps them up to date in makeMove
+int materialEvaluation(const Position& pos)
+{
+    int eval = 0;
+    for (int square = 0; square < 81; square++)
+    {
+        eval += materialTerm(pos, square);
+    }
+    for (int i = 1; i < 8; i++)
+    {
+        eval += handTerm(pos, true, i);
+        eval += handTerm(pos, false, i);
+    }
+    return eval;
+}
+
+#ifdef __AVX2__
+// Eight squares starting at a multiple of eight, from a bitboard with the squares in 81 consecutive bits
+inline uint32_t squareByte(const uint64_t (&bits)[2], int first)
+{
+    return (uint32_t) (bits[first >> 6] >> (first & 63)) & 0xFF;
+}
+
+// Kiki terms of squares 0 to 79, eight squares per step
+int kikiKernel(const Bitboard (&kiki)[4], int k1, int k2)
+{
+    uint64_t bits[4][2];
+    for (int i = 0; i < 4; i++)
+    {
+        kiki[i].toConsecutive(bits[i]);
+    }
+    const __m256i lane  = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i one   = _mm256_set1_epi32(1);
+    const __m256i two   = _mm256_set1_epi32(2);
+    const int* table    = (const int*) &kikiKingSafetyFixed[0][0][0];
+    __m256i sum = _mm256_setzero_si256();
+    for (int first = 0; first < 80; first += 8)
+    {
+        // One byte per kiki bitboard, shifted so bits 0, 8, 16 and 24 of each lane belong to its square
+        const uint32_t packed = squareByte(bits[0], first)       | squareByte(bits[1], first) << 8 |
+                                squareByte(bits[2], first) << 16 | squareByte(bits[3], first) << 24;
+        const __m256i codes = _mm256_srlv_epi32(_mm256_set1_epi32(packed), lane);
+        const __m256i defence = _mm256_or_si256(_mm256_and_si256(codes, one),
+                                                _mm256_and_si256(_mm256_srli_epi32(codes, 7), two));
+        const __m256i attack  = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(codes, 16), one),
+                                                _mm256_and_si256(_mm256_srli_epi32(codes, 23), two));
+
+        const __m256i map1 = _mm256_loadu_si256((const __m256i*) &oneSquareMap[k1][first]);
+        const __m256i map2 = _mm256_loadu_si256((const __m256i*) &twoSquareMap[k2][first]);
+        const __m256i index1 = _mm256_add_epi32(_mm256_slli_epi32(map1, 4),
+                                                _mm256_add_epi32(_mm256_slli_epi32(defence, 2), attack));
+        const __m256i index2 = _mm256_add_epi32(_mm256_slli_epi32(map2, 4),
+                                                _mm256_add_epi32(_mm256_slli_epi32(attack, 2), defence));
+
+        // Gather 16-bit entries as 32-bit words and sign extend the low half
+        const __m256i term1 = _mm256_srai_epi32(_mm256_slli_epi32(_mm256_i32gather_epi32(table, index1, 2), 16), 16);
+        const __m256i term2 = _mm256_srai_epi32(_mm256_slli_epi32(_mm256_i32gather_epi32(table, index2, 2), 16), 16);
+        sum = _mm256_add_epi32(sum, _mm256_sub_epi32(term1, term2));
+    }
+    __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(half);
+}
+#endif
+
+// Fixed-point king-safety term of the evaluation
+int kikiEvaluation(const Position& pos)
+{
+    int eval = 0;
+    Bitboard kiki[4];
+    pos.kikiBitboards(kiki);
+    int k1 = (pos.pieceMaps[KING] &   pos.pieceMaps[8] ).BSF();
+    int k2 = (pos.pieceMaps[KING] & (~pos.pieceMaps[8])).BSF();
+#ifdef __AVX2__
+    // The kernel covers squares 0 to 79, the integer sums agree exactly with the scalar loop
+    eval += kikiKernel(kiki, k1, k2);
+    for (int square = 80; square < 81; square++)
+#else
+    for (int square = 0; square < 81; square++)
+#endif
+    {
+        int kiki_defence = (kiki[0] & squareMask[square] ? 1 : 0) + (kiki[1] & squareMask[square] ? 2 : 0);
+        int kiki_attack  = (kiki[2] & squareMask[square] ? 1 : 0) + (kiki[3] & squareMask[square] ? 2 : 0);
+        eval += kikiKingSafetyFixed[oneSquareMap[k1][square]][kiki_defence][kiki_attack];
+        eval -= kikiKingSafetyFixed[twoSquareMap[k2][square]][kiki_attack][kiki_defence];
+    }
+    return eval;
+}
+
+// Fixed-point evaluation for the search, in hundredths of the log-odds of evaluation()
+int evaluate(const Position& pos)
+{
+    return (pos.history.back().material + kikiEvaluation(pos)) * 100 / EVAL_ONE;
+}
+
+// Evaluation that stops at the material terms when those plus or minus the king-safety swing fall outside
+// [lower, upper], lazy is set when it does. The returned bound then lies on the same side of the window as evaluate()
+int lazyEvaluate(const Position& pos, int lower, int upper, bool& lazy)
+{
+    const int material = pos.history.back().material;
+    const int highest = (material + kikiSwing) * 100 / EVAL_ONE;
+    const int lowest  = (material - kikiSwing) * 100 / EVAL_ONE;
+    lazy = true;
+    if (highest <= lower)
+    {
+        return highest;
+    }
+    if (lowest >= upper)
+    {
+        return lowest;
+    }
+    lazy = false;
+    return (material + kikiEvaluation(pos)) * 100 / EVAL_ONE;
+}
+
 double evaluation(const Position& pos)
 {
     double eval = 0;
@@ -53,7 +269,7 @@ double evaluation(const Position& pos)
         int piece = pos.mailbox[square];
         eval += (pos.pieceMaps[8] & squareMask[square] ?
                  pieceValue[piece] + pieceSquareTable[piece][square] :
-                -pieceValue[piece] - pieceSquareTable[piece][81 - square]);
+                -pieceValue[piece] - mirroredSquareValue(piece, square));
 
         int kiki_defence = (kiki[0] & squareMask[square] ? 1 : 0) + (kiki[1] & squareMask[square] ? 2 : 0);
         int kiki_attack  = (kiki[2] & squareMask[square] ? 1 : 0) + (kiki[3] & squareMask[square] ? 2 : 0);
@@ -71,6 +287,140 @@ double evaluation(const Position& pos)
     return eval;
 }
 
+// Positions per block of the batch evaluation, one per lane of a vector of four doubles
+const int BATCH_LANES = 4;
+
+// Table indices of the terms evaluation() adds for a block of positions, lane-minor so each term loads as one vector
+struct alignas(32) BatchFeatures
+{
+    int32_t material[81][BATCH_LANES];
+    int32_t kikiOne[81][BATCH_LANES];
+    int32_t kikiTwo[81][BATCH_LANES];
+    int32_t handOne[7][BATCH_LANES];
+    int32_t handTwo[7][BATCH_LANES];
+};
+
+static void extractFeatures(const Position& pos, BatchFeatures& features, int lane)
+{
+    Bitboard kiki[4];
+    pos.kikiBitboards(kiki);
+    int k1 = (pos.pieceMaps[KING] &   pos.pieceMaps[8] ).BSF();
+    int k2 = (pos.pieceMaps[KING] & (~pos.pieceMaps[8])).BSF();
+    for (int square = 0; square < 81; square++)
+    {
+        const int owner = pos.pieceMaps[8].bit(square);
+        const int kiki_defence = kiki[0].bit(square) + 2 * kiki[1].bit(square);
+        const int kiki_attack  = kiki[2].bit(square) + 2 * kiki[3].bit(square);
+        features.material[square][lane] = (owner * 16 + pos.mailbox[square]) * 81 + square;
+        features.kikiOne[square][lane] = oneSquareMap[k1][square] * 16 + kiki_defence * 4 + kiki_attack;
+        features.kikiTwo[square][lane] = twoSquareMap[k2][square] * 16 + kiki_attack * 4 + kiki_defence;
+    }
+    for (int i = 1; i < 8; i++)
+    {
+        features.handOne[i - 1][lane] = (i - 1) * 19 + hand_count(pos.hand[true], i);
+        features.handTwo[i - 1][lane] = (i - 1) * 19 + hand_count(pos.hand[false], i);
+    }
+}
+
+#ifdef __AVX2__
+// Four doubles from 32-bit indices, the masked form gives the gather a defined source
+inline __m256d gatherDoubles(const double* base, __m128i index)
+{
+    return _mm256_mask_i32gather_pd(_mm256_setzero_pd(), base, index, _mm256_castsi256_pd(_mm256_set1_epi64x(-1)), 8);
+}
+#endif
+
+// Sums the terms of every lane in the order of evaluation(), so the rounding and the results are the same
+static void evaluateBlock(const BatchFeatures& features, const double* material, double (&out)[BATCH_LANES])
+{
+    const double* kiki = &kikiKingSafety[0][0][0];
+    const double* hand = &pieceInHand[0][0];
+#ifdef __AVX2__
+    __m256d eval = _mm256_setzero_pd();
+    for (int square = 0; square < 81; square++)
+    {
+        const __m128i materialIndex = _mm_load_si128((const __m128i*) features.material[square]);
+        const __m128i oneIndex      = _mm_load_si128((const __m128i*) features.kikiOne[square]);
+        const __m128i twoIndex      = _mm_load_si128((const __m128i*) features.kikiTwo[square]);
+        eval = _mm256_add_pd(eval, gatherDoubles(material, materialIndex));
+        eval = _mm256_add_pd(eval, gatherDoubles(kiki, oneIndex));
+        eval = _mm256_sub_pd(eval, gatherDoubles(kiki, twoIndex));
+    }
+    for (int i = 0; i < 7; i++)
+    {
+        eval = _mm256_add_pd(eval, gatherDoubles(hand, _mm_load_si128((const __m128i*) features.handOne[i])));
+        eval = _mm256_sub_pd(eval, gatherDoubles(hand, _mm_load_si128((const __m128i*) features.handTwo[i])));
+    }
+    _mm256_storeu_pd(out, eval);
+#else
+    double eval[BATCH_LANES] = {0};
+    for (int square = 0; square < 81; square++)
+    {
+        for (int lane = 0; lane < BATCH_LANES; lane++)
+        {
+            eval[lane] += material[features.material[square][lane]];
+            eval[lane] += kiki[features.kikiOne[square][lane]];
+            eval[lane] -= kiki[features.kikiTwo[square][lane]];
+        }
+    }
+    for (int i = 0; i < 7; i++)
+    {
+        for (int lane = 0; lane < BATCH_LANES; lane++)
+        {
+            eval[lane] += hand[features.handOne[i][lane]];
+            eval[lane] -= hand[features.handTwo[i][lane]];
+        }
+    }
+    std::copy(eval, eval + BATCH_LANES, out);
+#endif
+}
+
+// evaluation() of n positions, split over all cores in blocks of BATCH_LANES positions
+void evaluateBatch(const Position* positions, int n, double* out)
+{
+    // Piece value plus piece-square term per owner (1 for player one), the sums evaluation() adds per square
+    std::vector<double> material(2 * 16 * 81);
+    for (int piece = 0; piece < 16; piece++)
+    {
+        for (int square = 0; square < 81; square++)
+        {
+            material[(16 + piece) * 81 + square] =  pieceValue[piece] + pieceSquareTable[piece][square];
+            material[piece * 81 + square]        = -pieceValue[piece] - mirroredSquareValue(piece, square);
+        }
+    }
+
+    auto work = [&](int firstBlock, int lastBlock)
+    {
+        BatchFeatures features;
+        double eval[BATCH_LANES];
+        for (int block = firstBlock; block < lastBlock; block++)
+        {
+            const int first = block * BATCH_LANES;
+            const int count = std::min(BATCH_LANES, n - first);
+            // A partial last block repeats its final position in the spare lanes
+            for (int lane = 0; lane < BATCH_LANES; lane++)
+            {
+                extractFeatures(positions[first + std::min(lane, count - 1)], features, lane);
+            }
+            evaluateBlock(features, material.data(), eval);
+            std::copy(eval, eval + count, out + first);
+        }
+    };
+
+    // 256 blocks take about 1 ms, starting a thread about 12 us
+    const int blocks = (n + BATCH_LANES - 1) / BATCH_LANES;
+    const int threads = std::max(1, std::min((int) std::thread::hardware_concurrency(), blocks / 256));
+    std::vector<std::thread> workers;
+    for (int t = 1; t < threads; t++)
+    {
+        workers.emplace_back(work, (int) ((int64_t) blocks * t / threads), (int) ((int64_t) blocks * (t + 1) / threads));
+    }
+    work(0, blocks / threads);
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+}
 
 void partialEval(const Position& pos, double score)
 {
@@ -97,7 +447,10 @@ void partialEval(const Position& pos, double score)
         if (piece > 0 && (~pos.pieceMaps[8]) & squareMask[square])
         {
             del_pieceValue[piece] -= LL_partial;
-            del_pieceSquareTable[piece][81 - square] -= LL_partial;
+            if (mirroredSquare(piece, square) < 16 * 81)
+            {
+                (&del_pieceSquareTable[0][0])[mirroredSquare(piece, square)] -= LL_partial;
+            }
         }
 
         int kiki_defence = (kiki[0] & squareMask[square] ? 1 : 0) + (kiki[1] & squareMask[square] ? 2 : 0);
@@ -250,6 +603,7 @@ void loadParameters()
 
         inFile.close();
     }
+    quantiseParameters();
     std::cout << "Completed\n";
 }
 
@@ -293,7 +647,11 @@ void counts()
             counts_kikiKingSafety[twoSquareMap[k2][square]][kiki_attack][kiki_defence]++;
 
             int piece = pos.mailbox[square];
-            counts_pieceSquareTable[piece][(pos.pieceMaps[8] & squareMask[square] ? square : 81 - square)]++;
+            const int index = (pos.pieceMaps[8] & squareMask[square] ? 81 * piece + square : mirroredSquare(piece, square));
+            if (index < 16 * 81)
+            {
+                (&counts_pieceSquareTable[0][0])[index]++;
+            }
         }
 
         for (int i = 1; i < 8; i++)
@@ -1,7 +1,22 @@
 #ifndef LEARNER_H_INCLUDED
 #define LEARNER_H_INCLUDED
 
+// Fixed-point scale of the search evaluation, one unit of log-odds
+const int EVAL_ONE = 8192;
+// Positions the king-safety swing of lazyEvaluate() is measured on
+const int KIKI_SWING_SAMPLES = 20000;
+
+extern int kikiSwing;
+
+void quantiseParameters();
+int materialTerm(const Position& pos, int square);
+int handTerm(const Position& pos, bool player, int piece);
+int materialEvaluation(const Position& pos);
+int kikiEvaluation(const Position& pos);
+int evaluate(const Position& pos);
+int lazyEvaluate(const Position& pos, int lower, int upper, bool& lazy);
 double evaluation(const Position& pos);
+void evaluateBatch(const Position* positions, int n, double* out);
 void partialEval(const Position& pos, double score);
 
 void descent();
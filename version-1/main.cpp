@@ -12,6 +12,8 @@
 #include "random.h"
 #include "search.h"
 #include "learner.h"
+#include "usi.h"
+#include "bench.h"
 
 
 void moveGeneratorTest()
@@ -33,10 +35,11 @@ void moveGeneratorTest()
 
 
 
-int main()
+int main(int argc, char* argv[])
 {
     Position test;
     initialiseBitboards();
+    initialiseZobrist();
     test.loadInitial();
 
     test.loadSFEN("ln3g1nl/1r1s2k2/ppp1ppspp/4g1p2/3N5/2PP1B3/PP2PPPPP/2G4R1/L1S1KGSNL b Pb 1");
@@ -75,6 +78,24 @@ int main()
     loadParameters();
 
     //loadParameters();
+    // "samurai bench [depth]" searches the bench positions
+    if (argc > 1 && std::string(argv[1]) == "bench")
+    {
+        bench(argc > 2 ? std::stoi(argv[2]) : BENCH_DEPTH);
+        return 0;
+    }
+    // "samurai evalbench [file]" compares evaluateBatch() with evaluation() on a training file
+    if (argc > 1 && std::string(argv[1]) == "evalbench")
+    {
+        evalBench(argc > 2 ? argv[2] : "");
+        return 0;
+    }
+    // Play in the console with "samurai play", otherwise speak USI
+    if (argc < 2 || std::string(argv[1]) != "play")
+    {
+        usiLoop();
+        return 0;
+    }
     engineMove(test, 100000);
     for (int iter = 0; iter < 1000; iter++)
     {
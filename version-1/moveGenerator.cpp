@@ -17,23 +17,14 @@ void (*addMoves)(const Position& pos, moveList& moves, const Bitboard& empty, co
 
 void kingMoves(const Position& pos, moveList& moves)
 {
-    // This function can be optimized by not considering all non-sliding pieces, but only those that attack a square the king can move too
     // Auxiliary bitboards
     const Bitboard occupied = pos.pieceMaps[0] | pos.pieceMaps[1] | pos.pieceMaps[2] | pos.pieceMaps[3] |
                               pos.pieceMaps[4] | pos.pieceMaps[5] | pos.pieceMaps[6] | pos.pieceMaps[7];
     const Bitboard ownPieces = (pos.playerOne ? pos.pieceMaps[8] : ~pos.pieceMaps[8]) & occupied;
-    Bitboard enemyPieces = ~ownPieces & occupied;
     const Bitboard emptyOrKing = ~(occupied ^ (ownPieces & pos.pieceMaps[KING])) & Bitboard(true);
-    // Determine attacked squares
-    Bitboard attackedSquares(false);
-
-    while (enemyPieces)
-    {
-        int square = enemyPieces.BSF();
-        enemyPieces.removeLSB();
-        uint8_t piece = pos.mailbox[square];
-        attackedSquares |= attackMap(piece, square, emptyOrKing, !pos.playerOne);
-    }
+    // Determine attacked squares, the king only blocks an enemy line when it is in check
+    const Bitboard attackedSquares = (pos.inCheck() ? pos.attackedSquares(!pos.playerOne, emptyOrKing) :
+                                                      pos.effectAtLeast(!pos.playerOne, 1));
 
     int kingSquare = (pos.pieceMaps[KING] & ownPieces).BSF();
     Bitboard kingMoves = ~attackedSquares & (~ownPieces) & kingAttack(kingSquare);
@@ -40,6 +40,24 @@ struct moveList {
             return a.value > b.value;
         });
     }
+
+    // Sort on scores wider than the 8 bits that fit in a move, highest score first
+    int scores[MAX_LEGAL_MOVES];
+
+    void sortByScore() {
+        uint64_t keys[MAX_LEGAL_MOVES];
+        for (int i = 0; i < size; i++) {
+            // Flipping the sign bit orders the signed scores as unsigned keys
+            keys[i] = ((uint64_t) ((uint32_t) scores[i] ^ 0x80000000u) << 32) | (uint32_t) moveList[i].value;
+        }
+        std::sort(keys, keys + size, [](const uint64_t a, const uint64_t b) {
+            return a > b;
+        });
+        for (int i = 0; i < size; i++) {
+            moveList[i].value = (int) (uint32_t) keys[i];
+            scores[i] = (int) ((uint32_t) (keys[i] >> 32) ^ 0x80000000u);
+        }
+    }
 };
 
 
@@ -0,0 +1,296 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+#include "position.h"
+#include "nnue.h"
+
+// Network file: the magic number and the three dimensions as 32-bit integers, then in host byte order the int16
+// feature biases and weights (one row of NNUE_HALF_DIMENSIONS per feature), the int32 biases and int8 weights
+// (row major, one row per output) of both hidden layers, and the int32 bias and int8 weights of the output
+const uint32_t NNUE_MAGIC = 0x314E4E53; // "SNN1"
+// Hidden sums are scaled down by 2^6 before clipping, the output by 16 to the units of evaluate()
+const int NNUE_WEIGHT_SHIFT = 6;
+const int NNUE_OUTPUT_SCALE = 16;
+
+// Feature index of a piece kind, -1 for kings and the missing promoted gold
+const int FEATURE_KIND[16] = {-1, 0, 1, 2, 3, 4, 5, 6, -1, 7, 8, -1, 9, 10, 11, 12};
+// First hand feature of a piece type, a player holds at most 2 rooks and bishops, 4 golds, silvers, knights and
+// lances and 18 pawns
+const int HAND_FEATURE[8] = {0, 0, 2, 4, 8, 12, 16, 20};
+
+bool useNNUE = false;
+bool networkLoaded = false;
+
+std::vector<int16_t> featureBiases;
+std::vector<int16_t> featureWeights;
+alignas(32) int32_t hidden1Biases[NNUE_HIDDEN];
+alignas(32) int8_t  hidden1Weights[NNUE_HIDDEN][2 * NNUE_HALF_DIMENSIONS];
+alignas(32) int32_t hidden2Biases[NNUE_HIDDEN];
+alignas(32) int8_t  hidden2Weights[NNUE_HIDDEN][NNUE_HIDDEN];
+int32_t outputBias;
+alignas(32) int8_t  outputWeights[NNUE_HIDDEN];
+
+template <typename T>
+static bool readArray(std::ifstream& in, T* values, size_t count)
+{
+    in.read(reinterpret_cast<char*>(values), count * sizeof(T));
+    return (bool) in;
+}
+
+bool loadNetwork(const std::string& file)
+{
+    std::ifstream in(file, std::ios::binary);
+    uint32_t header[4];
+    if (!in.is_open() || !readArray(in, header, 4) || header[0] != NNUE_MAGIC ||
+        header[1] != NNUE_HALF_DIMENSIONS || header[2] != NNUE_HIDDEN || header[3] != NNUE_FEATURES)
+    {
+        return false;
+    }
+    // Everything is read before anything is replaced, a short or broken file keeps the current network
+    std::vector<int16_t> biases(NNUE_HALF_DIMENSIONS);
+    std::vector<int16_t> weights((size_t) NNUE_FEATURES * NNUE_HALF_DIMENSIONS);
+    std::vector<int32_t> h1Biases(NNUE_HIDDEN);
+    std::vector<int8_t>  h1Weights(NNUE_HIDDEN * 2 * NNUE_HALF_DIMENSIONS);
+    std::vector<int32_t> h2Biases(NNUE_HIDDEN);
+    std::vector<int8_t>  h2Weights(NNUE_HIDDEN * NNUE_HIDDEN);
+    int32_t outBias;
+    std::vector<int8_t>  outWeights(NNUE_HIDDEN);
+    if (!readArray(in, biases.data(), biases.size()) ||
+        !readArray(in, weights.data(), weights.size()) ||
+        !readArray(in, h1Biases.data(), h1Biases.size()) ||
+        !readArray(in, h1Weights.data(), h1Weights.size()) ||
+        !readArray(in, h2Biases.data(), h2Biases.size()) ||
+        !readArray(in, h2Weights.data(), h2Weights.size()) ||
+        !readArray(in, &outBias, 1) ||
+        !readArray(in, outWeights.data(), outWeights.size()))
+    {
+        return false;
+    }
+    featureBiases.swap(biases);
+    featureWeights.swap(weights);
+    std::copy(h1Biases.begin(), h1Biases.end(), hidden1Biases);
+    std::copy(h1Weights.begin(), h1Weights.end(), &hidden1Weights[0][0]);
+    std::copy(h2Biases.begin(), h2Biases.end(), hidden2Biases);
+    std::copy(h2Weights.begin(), h2Weights.end(), &hidden2Weights[0][0]);
+    outputBias = outBias;
+    std::copy(outWeights.begin(), outWeights.end(), outputWeights);
+    networkLoaded = true;
+    return true;
+}
+
+bool networkActive()
+{
+    return useNNUE && networkLoaded;
+}
+
+// Squares and colours are seen from the perspective, player two looks at the board turned around
+inline int kingFeatureBase(const Position& pos, int perspective)
+{
+    const int king = (pos.pieceMaps[KING] & pos.sideOccupancy(perspective)).BSF();
+    return (perspective ? king : 80 - king) * NNUE_FEATURES_PER_KING;
+}
+
+inline int boardFeature(int base, int perspective, int piece, int owner, int square)
+{
+    return base + ((owner == perspective ? 0 : 13) + FEATURE_KIND[piece]) * 81 + (perspective ? square : 80 - square);
+}
+
+// Feature of holding the count-th piece of a type, count starts at 1
+inline int handFeature(int base, int perspective, int piece, int owner, int count)
+{
+    return base + NNUE_BOARD_FEATURES + (owner == perspective ? 0 : 38) + HAND_FEATURE[piece] + count - 1;
+}
+
+inline void addFeature(int16_t* values, int feature)
+{
+    const int16_t* row = &featureWeights[(size_t) feature * NNUE_HALF_DIMENSIONS];
+    for (int i = 0; i < NNUE_HALF_DIMENSIONS; i++)
+    {
+        values[i] += row[i];
+    }
+}
+
+inline void subtractFeature(int16_t* values, int feature)
+{
+    const int16_t* row = &featureWeights[(size_t) feature * NNUE_HALF_DIMENSIONS];
+    for (int i = 0; i < NNUE_HALF_DIMENSIONS; i++)
+    {
+        values[i] -= row[i];
+    }
+}
+
+// Accumulates one perspective from scratch
+void refreshAccumulator(const Position& pos, Accumulator& accumulator, int perspective)
+{
+    int16_t* values = accumulator.values[perspective];
+    std::copy(featureBiases.begin(), featureBiases.end(), values);
+    const int base = kingFeatureBase(pos, perspective);
+    Bitboard pieces = pos.occupancy() & ~pos.pieceMaps[KING];
+    while (pieces)
+    {
+        const int square = pieces.BSF();
+        pieces.removeLSB();
+        const int owner = (pos.pieceMaps[8] & squareMask[square] ? 1 : 0);
+        addFeature(values, boardFeature(base, perspective, pos.mailbox[square], owner, square));
+    }
+    for (int owner = 0; owner < 2; owner++)
+    {
+        for (int piece = ROOK; piece <= PAWN; piece++)
+        {
+            for (int count = 1; count <= hand_count(pos.hand[owner], piece); count++)
+            {
+                addFeature(values, handFeature(base, perspective, piece, owner, count));
+            }
+        }
+    }
+}
+
+// Starts the accumulator stack at the current position, or leaves it empty when no network is used
+void initialiseAccumulators(Position& pos)
+{
+    pos.accumulators.clear();
+    if (networkActive())
+    {
+        pos.accumulators.emplace_back();
+        refreshAccumulator(pos, pos.accumulators.back(), 0);
+        refreshAccumulator(pos, pos.accumulators.back(), 1);
+    }
+}
+
+// Called by makeMove after the move, updates a copy of the previous accumulator by the features the move changes.
+// The perspective of a king that moved is accumulated from scratch
+void pushAccumulator(Position& pos, const Move& move)
+{
+    pos.accumulators.push_back(pos.accumulators.back());
+    Accumulator& accumulator = pos.accumulators.back();
+    const int mover = !pos.playerOne;
+    for (int perspective = 0; perspective < 2; perspective++)
+    {
+        int16_t* values = accumulator.values[perspective];
+        if (!move.isDrop() && move.movedPiece() == KING && perspective == mover)
+        {
+            refreshAccumulator(pos, accumulator, perspective);
+            continue;
+        }
+        const int base = kingFeatureBase(pos, perspective);
+        if (move.isDrop())
+        {
+            const int count = hand_count(pos.hand[mover], move.movedType()) + 1;
+            subtractFeature(values, handFeature(base, perspective, move.movedType(), mover, count));
+            addFeature(values, boardFeature(base, perspective, move.movedType(), mover, move.to()));
+            continue;
+        }
+        if (move.movedPiece() != KING)
+        {
+            subtractFeature(values, boardFeature(base, perspective, move.movedPiece(), mover, move.from()));
+            addFeature(values, boardFeature(base, perspective, pos.mailbox[move.to()], mover, move.to()));
+        }
+        if (move.isCapture())
+        {
+            const int count = hand_count(pos.hand[mover], move.capturedType());
+            subtractFeature(values, boardFeature(base, perspective, move.capturedPiece(), !mover, move.to()));
+            addFeature(values, handFeature(base, perspective, move.capturedType(), mover, count));
+        }
+    }
+}
+
+// Output sums of an int8 layer over unsigned 8-bit inputs, the input count is a multiple of 32
+static void affine(const uint8_t* input, int inputs, const int8_t* weights, const int32_t* biases, int outputs, int32_t* output)
+{
+    for (int out = 0; out < outputs; out++)
+    {
+        const int8_t* row = weights + out * inputs;
+        int32_t sum = biases[out];
+#if defined(__AVX2__)
+        // Products of neighbouring inputs are added in 16 bits, 2 * 127 * 128 cannot overflow
+        const __m256i ones = _mm256_set1_epi16(1);
+        __m256i sums = _mm256_setzero_si256();
+        for (int i = 0; i < inputs; i += 32)
+        {
+            const __m256i products = _mm256_maddubs_epi16(_mm256_loadu_si256((const __m256i*) (input + i)),
+                                                          _mm256_loadu_si256((const __m256i*) (row + i)));
+            sums = _mm256_add_epi32(sums, _mm256_madd_epi16(products, ones));
+        }
+        __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+        half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+        half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+        sum += _mm_cvtsi128_si32(half);
+#elif defined(__SSSE3__)
+        const __m128i ones = _mm_set1_epi16(1);
+        __m128i sums = _mm_setzero_si128();
+        for (int i = 0; i < inputs; i += 16)
+        {
+            const __m128i products = _mm_maddubs_epi16(_mm_loadu_si128((const __m128i*) (input + i)),
+                                                       _mm_loadu_si128((const __m128i*) (row + i)));
+            sums = _mm_add_epi32(sums, _mm_madd_epi16(products, ones));
+        }
+        sums = _mm_add_epi32(sums, _mm_shuffle_epi32(sums, _MM_SHUFFLE(1, 0, 3, 2)));
+        sums = _mm_add_epi32(sums, _mm_shuffle_epi32(sums, _MM_SHUFFLE(2, 3, 0, 1)));
+        sum += _mm_cvtsi128_si32(sums);
+#else
+        for (int i = 0; i < inputs; i++)
+        {
+            sum += input[i] * row[i];
+        }
+#endif
+        output[out] = sum;
+    }
+}
+
+// Scales the sums down and clips them to [0, 127]
+static void clippedRelu(const int32_t* sums, int count, uint8_t* output)
+{
+    for (int i = 0; i < count; i++)
+    {
+        output[i] = (uint8_t) std::max(0, std::min(127, sums[i] >> NNUE_WEIGHT_SHIFT));
+    }
+}
+
+// Network evaluation in the units of evaluate(), from player one's point of view
+int evaluateNNUE(const Position& pos)
+{
+    Accumulator fresh;
+    const Accumulator* accumulator = &fresh;
+    if (!pos.accumulators.empty())
+    {
+        accumulator = &pos.accumulators.back();
+    }
+    else
+    {
+        refreshAccumulator(pos, fresh, 0);
+        refreshAccumulator(pos, fresh, 1);
+    }
+
+    // The side to move comes first
+    alignas(32) uint8_t input[2 * NNUE_HALF_DIMENSIONS];
+    for (int half = 0; half < 2; half++)
+    {
+        const int16_t* values = accumulator->values[half == 0 ? pos.playerOne : !pos.playerOne];
+        for (int i = 0; i < NNUE_HALF_DIMENSIONS; i++)
+        {
+            input[half * NNUE_HALF_DIMENSIONS + i] = (uint8_t) std::max(0, std::min(127, (int) values[i]));
+        }
+    }
+
+    alignas(32) int32_t sums[NNUE_HIDDEN];
+    alignas(32) uint8_t hidden1[NNUE_HIDDEN];
+    alignas(32) uint8_t hidden2[NNUE_HIDDEN];
+    affine(input, 2 * NNUE_HALF_DIMENSIONS, &hidden1Weights[0][0], hidden1Biases, NNUE_HIDDEN, sums);
+    clippedRelu(sums, NNUE_HIDDEN, hidden1);
+    affine(hidden1, NNUE_HIDDEN, &hidden2Weights[0][0], hidden2Biases, NNUE_HIDDEN, sums);
+    clippedRelu(sums, NNUE_HIDDEN, hidden2);
+    int32_t output = outputBias;
+    for (int i = 0; i < NNUE_HIDDEN; i++)
+    {
+        output += hidden2[i] * outputWeights[i];
+    }
+    const int eval = output / NNUE_OUTPUT_SCALE;
+    return (pos.playerOne ? eval : -eval);
+}
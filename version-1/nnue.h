@@ -0,0 +1,35 @@
+#ifndef NNUE_H_INCLUDED
+#define NNUE_H_INCLUDED
+
+#include <cstdint>
+#include <string>
+
+struct Position;
+struct Move;
+
+// HalfKP network: every board piece other than the kings and every piece in hand is a feature relative to the
+// king of the perspective. The 256 accumulated values of both perspectives feed two hidden layers of 32
+const int NNUE_HALF_DIMENSIONS = 256;
+const int NNUE_HIDDEN = 32;
+// Non-king piece kinds of both colours on 81 squares, then 38 hand counts of both colours
+const int NNUE_BOARD_FEATURES = 2 * 13 * 81;
+const int NNUE_FEATURES_PER_KING = NNUE_BOARD_FEATURES + 2 * 38;
+const int NNUE_FEATURES = 81 * NNUE_FEATURES_PER_KING;
+
+// Feature transformer output of both perspectives (1 for player one)
+struct alignas(32) Accumulator
+{
+    int16_t values[2][NNUE_HALF_DIMENSIONS];
+};
+
+// The network evaluates instead of evaluate() when one is loaded and selected
+extern bool useNNUE;
+
+bool loadNetwork(const std::string& file);
+bool networkActive();
+void refreshAccumulator(const Position& pos, Accumulator& accumulator, int perspective);
+void initialiseAccumulators(Position& pos);
+void pushAccumulator(Position& pos, const Move& move);
+int evaluateNNUE(const Position& pos);
+
+#endif // NNUE_H_INCLUDED
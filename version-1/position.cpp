@@ -1,8 +1,82 @@
 #include <iostream>
 #include <cctype>
+#include <algorithm>
 #include "bitboard.h"
 #include "position.h"
 #include "random.h"
+#include "learner.h"
+
+uint64_t zobristPiece[2][16][81];
+uint64_t zobristHand[2][8][19];
+uint64_t zobristSide;
+uint64_t cuckooKey[CUCKOO_SIZE];
+Move cuckooMove[CUCKOO_SIZE];
+
+inline int cuckooFirstHash(uint64_t key)  { return key & (CUCKOO_SIZE - 1); }
+inline int cuckooSecondHash(uint64_t key) { return (key >> 16) & (CUCKOO_SIZE - 1); }
+
+void initialiseZobrist()
+{
+    for (int player = 0; player < 2; player++)
+    {
+        for (int piece = 0; piece < 16; piece++)
+        {
+            for (int square = 0; square < 81; square++)
+            {
+                zobristPiece[player][piece][square] = randomLong();
+            }
+        }
+        for (int piece = 0; piece < 8; piece++)
+        {
+            for (int count = 0; count < 19; count++)
+            {
+                zobristHand[player][piece][count] = randomLong();
+            }
+        }
+    }
+    zobristSide = randomLong();
+
+    // A move is reversible if the piece can move back on an empty board, pawns, lances and knights never can
+    const int reversiblePieces[11] = {KING, ROOK, BISHOP, GOLD_GENERAL, SILVER_GENERAL, PROMOTED_ROOK, PROMOTED_BISHOP,
+                                      PROMOTED_SILVER_GENERAL, PROMOTED_KNIGHT, PROMOTED_LANCE, PROMOTED_PAWN};
+    const Bitboard empty(true);
+    for (int i = 0; i < CUCKOO_SIZE; i++)
+    {
+        cuckooKey[i] = 0;
+        cuckooMove[i] = Move();
+    }
+    for (int player = 0; player < 2; player++)
+    {
+        for (int piece : reversiblePieces)
+        {
+            for (int from = 0; from < 81; from++)
+            {
+                for (int to = from + 1; to < 81; to++)
+                {
+                    if (!(attackMap(piece, from, empty, player) & squareMask[to]) ||
+                        !(attackMap(piece, to, empty, player) & squareMask[from]))
+                    {
+                        continue;
+                    }
+                    // Insert by displacing the occupant to its other slot until an empty slot is found
+                    Move move(from, to, false, false, piece, 0);
+                    uint64_t moveKey = zobristPiece[player][piece][from] ^ zobristPiece[player][piece][to] ^ zobristSide;
+                    int slot = cuckooFirstHash(moveKey);
+                    while (true)
+                    {
+                        std::swap(cuckooKey[slot], moveKey);
+                        std::swap(cuckooMove[slot], move);
+                        if (move.value == 0)
+                        {
+                            break;
+                        }
+                        slot = (slot == cuckooFirstHash(moveKey)) ? cuckooSecondHash(moveKey) : cuckooFirstHash(moveKey);
+                    }
+                }
+            }
+        }
+    }
+}
 
 void Position::print()
 {
@@ -190,6 +264,8 @@ void Position::loadRegularFormat(std::string& board, int handOne, int handTwo, b
             pieceMaps[value & 7] |= squareMask[square];
         }
     }
+    loadKey();
+    resetHistory();
 }
 
 void Position::loadSFEN(const char* sfen)
@@ -245,13 +321,15 @@ void Position::loadSFEN(const char* sfen)
         if (std::isalpha(sfen[i]))
         {
             int piece = pieceMap[std::tolower(sfen[i]) - 'a'];
-            add_hand(hand[std::isupper(sfen[i])], piece, amount);
+            add_hand(hand[std::isupper(sfen[i]) != 0], piece, amount);
         }
         amount = std::isdigit(sfen[i]) ? sfen[i] - '0' : 1;
         i++;
     }
 
     loadMailbox();
+    loadKey();
+    resetHistory();
 }
 
 void Position::loadInitial() {
@@ -286,6 +364,39 @@ void Position::loadMailbox()
     }
 }
 
+void Position::loadKey()
+{
+    key = (playerOne ? 0 : zobristSide);
+    Bitboard pieces = occupancy();
+    while (pieces)
+    {
+        int square = pieces.BSF();
+        pieces.removeLSB();
+        key ^= zobristPiece[(bool) (pieceMaps[8] & squareMask[square])][mailbox[square]][square];
+    }
+    for (int player = 0; player < 2; player++)
+    {
+        for (int piece = 1; piece < 8; piece++)
+        {
+            key ^= zobristHand[player][piece][hand_count(hand[player], piece)];
+        }
+    }
+}
+
+// Starts the game history at the current position
+void Position::resetHistory()
+{
+    history.clear();
+    history.emplace_back();
+    StateInfo& state = history.back();
+    state.key = key;
+    state.reversiblePlies = 0;
+    state.material = materialEvaluation(*this);
+    loadEffect(state.effect);
+    state.inCheck = checked();
+    initialiseAccumulators(*this);
+}
+
 Move Position::USIToMove(const char* move)
 {
     int pieceMap[26] = {0};
@@ -340,9 +451,47 @@ std::ostream& operator<<(std::ostream& os, const Move& move) {
 
 void Position::makeMove(Move& move)
 {
+    // Only the squares and hand count the move touches change the material terms
+    const bool handChanged = move.isDrop() || move.isCapture();
+    const int handPiece = (move.isDrop() ? move.movedType() : move.capturedType());
+    int material = history.back().material - materialTerm(*this, move.to());
+    if (!move.isDrop())
+    {
+        material -= materialTerm(*this, move.from());
+    }
+    if (handChanged)
+    {
+        material -= handTerm(*this, playerOne, handPiece);
+    }
+
+    // The attack counts change for the moved and captured pieces and for the sliders whose lines run through a
+    // square that is emptied or filled, their attacks are taken off before the move and put back after it
+    history.push_back(history.back());
+    StateInfo& state = history.back();
+    Bitboard empty = ~occupancy() & Bitboard(true);
+    Bitboard sliders;
+    if (!move.isCapture())
+    {
+        sliders |= slidersTo(move.to(), empty);
+    }
+    if (!move.isDrop())
+    {
+        sliders |= slidersTo(move.from(), empty);
+        sliders &= ~(squareMask[move.from()] | squareMask[move.to()]);
+    }
+    updateEffect(state.effect, sliders, empty, -1);
+    if (!move.isDrop())
+    {
+        updateEffect(state.effect, squareMask[move.from()] | (move.isCapture() ? squareMask[move.to()] : Bitboard()), empty, -1);
+    }
+
+    key ^= zobristSide;
     if (move.isDrop())
     {
         // Remove piece from hand, add piece to the board
+        key ^= zobristHand[playerOne][move.movedType()][hand_count(hand[playerOne], move.movedType())] ^
+               zobristHand[playerOne][move.movedType()][hand_count(hand[playerOne], move.movedType()) - 1] ^
+               zobristPiece[playerOne][move.movedType()][move.to()];
         sub_hand(hand[playerOne], move.movedType());
         if (playerOne)
         {
@@ -362,8 +511,13 @@ void Position::makeMove(Move& move)
             pieceMaps[8] &= ~squareMask[move.to()];
             pieceMaps[9] &= ~squareMask[move.to()];
 
+            key ^= zobristPiece[!playerOne][move.capturedPiece()][move.to()] ^
+                   zobristHand[playerOne][move.capturedType()][hand_count(hand[playerOne], move.capturedType())] ^
+                   zobristHand[playerOne][move.capturedType()][hand_count(hand[playerOne], move.capturedType()) + 1];
             add_hand(hand[playerOne], move.capturedType());
         }
+        key ^= zobristPiece[playerOne][move.movedPiece()][move.from()] ^
+               zobristPiece[playerOne][move.movedPiece() + 8 * move.isPromotion()][move.to()];
         // Move piece
         if (move.value & (1 << 19))
         {
@@ -388,11 +542,42 @@ void Position::makeMove(Move& move)
         mailbox[move.to()] += 8;
     }
     playerOne = !playerOne;
+
+    material += materialTerm(*this, move.to());
+    if (!move.isDrop())
+    {
+        material += materialTerm(*this, move.from());
+    }
+    if (handChanged)
+    {
+        material += handTerm(*this, !playerOne, handPiece);
+    }
+
+    empty = ~occupancy() & Bitboard(true);
+    updateEffect(state.effect, sliders | squareMask[move.to()], empty, 1);
+
+    // Pawns, lances and knights only move forward
+    const bool irreversible = move.isDrop() || move.isCapture() || move.isPromotion() ||
+                              move.movedPiece() == PAWN || move.movedPiece() == LANCE || move.movedPiece() == KNIGHT;
+    state.key = key;
+    state.reversiblePlies = (irreversible ? 0 : state.reversiblePlies + 1);
+    state.material = material;
+    state.inCheck = checked();
+    if (!accumulators.empty())
+    {
+        pushAccumulator(*this, move);
+    }
 }
 
 void Position::undoMove(Move& move)
 {
+    history.pop_back();
+    if (!accumulators.empty())
+    {
+        accumulators.pop_back();
+    }
     playerOne = !playerOne;
+    key ^= zobristSide;
     if (move.isPromotion())
     {
         pieceMaps[9] ^= squareMask[move.to()];
@@ -404,6 +589,9 @@ void Position::undoMove(Move& move)
     if (move.isDrop())
     {
         // Add piece to, remove piece from the board
+        key ^= zobristHand[playerOne][move.movedType()][hand_count(hand[playerOne], move.movedType())] ^
+               zobristHand[playerOne][move.movedType()][hand_count(hand[playerOne], move.movedType()) + 1] ^
+               zobristPiece[playerOne][move.movedType()][move.to()];
         add_hand(hand[playerOne], move.movedType());
         if (playerOne)
         {
@@ -430,6 +618,8 @@ void Position::undoMove(Move& move)
         // Move piece in mailbox
         mailbox[move.from()] = move.movedPiece();
         mailbox[move.to()] = 0;
+        key ^= zobristPiece[playerOne][move.movedPiece()][move.from()] ^
+               zobristPiece[playerOne][move.movedPiece() + 8 * move.isPromotion()][move.to()];
 
         // Remove piece
         if (move.isCapture())
@@ -444,6 +634,9 @@ void Position::undoMove(Move& move)
                 pieceMaps[8] |= squareMask[move.to()];
             }
 
+            key ^= zobristPiece[!playerOne][move.capturedPiece()][move.to()] ^
+                   zobristHand[playerOne][move.capturedType()][hand_count(hand[playerOne], move.capturedType())] ^
+                   zobristHand[playerOne][move.capturedType()][hand_count(hand[playerOne], move.capturedType()) - 1];
             sub_hand(hand[playerOne], move.capturedType());
 
             mailbox[move.to()] = move.capturedPiece();
@@ -451,43 +644,314 @@ void Position::undoMove(Move& move)
     }
 }
 
+// All pieces in occupied that attack the square, sliders look through the squares not in occupied.
+Bitboard Position::attackersTo(int square, const Bitboard& occupied) const
+{
+    const Bitboard empty      = ~occupied & Bitboard(true);
+    const Bitboard promoted   = pieceMaps[9];
+    const Bitboard unpromoted = ~pieceMaps[9];
+    const Bitboard goldMovers = pieceMaps[GOLD_GENERAL] |
+                                ((pieceMaps[PAWN] | pieceMaps[SILVER_GENERAL] | pieceMaps[KNIGHT] | pieceMaps[LANCE]) & promoted);
+
+    // Pieces that move the same for both players
+    Bitboard attackers = (kingAttack(square) & (pieceMaps[KING] | ((pieceMaps[ROOK] | pieceMaps[BISHOP]) & promoted))) |
+                         (rookAttack(square, empty) & pieceMaps[ROOK]) |
+                         (bishopAttack(square, empty) & pieceMaps[BISHOP]);
+
+    // The attackers of a player are found by looking from the square with the moves of the other player
+    for (int player = 0; player < 2; player++)
+    {
+        const Bitboard ownPieces = (player ? pieceMaps[8] : ~pieceMaps[8]);
+        attackers |= ownPieces & ((goldAttack(square, !player) & goldMovers) |
+                                  (silverAttack(square, !player) & pieceMaps[SILVER_GENERAL] & unpromoted) |
+                                  (knightAttack(square, !player) & pieceMaps[KNIGHT] & unpromoted) |
+                                  (lanceAttack(square, empty, !player) & pieceMaps[LANCE] & unpromoted) |
+                                  (lanceMask[!player][square] & kingMask[square] & pieceMaps[PAWN] & unpromoted));
+    }
+    return attackers & occupied;
+}
+
+// Rooks, bishops and lances of both players whose lines reach the square
+Bitboard Position::slidersTo(int square, const Bitboard& empty) const
+{
+    const Bitboard lances = pieceMaps[LANCE] & ~pieceMaps[9];
+    return (rookAttack(square, empty) & pieceMaps[ROOK]) |
+           (bishopAttack(square, empty) & pieceMaps[BISHOP]) |
+           (lanceAttack(square, empty, false) & lances & pieceMaps[8]) |
+           (lanceAttack(square, empty, true) & lances & ~pieceMaps[8]);
+}
+
+// Attacks of all pieces of both players as bitboards that each attack a square at most once: one per step direction
+// of every stepping piece type, with the whole set of such pieces moved at once, and one per slider. Returns the count,
+// 19 step sets and at most 8 slider pairs
+int Position::attackSets(const Bitboard& empty, BitboardPair (&sets)[32]) const
+{
+    const BitboardPair own(sideOccupancy(false), sideOccupancy(true));
+    const Bitboard promoted   = pieceMaps[9];
+    const Bitboard unpromoted = ~pieceMaps[9];
+    const Bitboard goldMover  = pieceMaps[GOLD_GENERAL] |
+                                ((pieceMaps[PAWN] | pieceMaps[SILVER_GENERAL] | pieceMaps[KNIGHT] | pieceMaps[LANCE]) & promoted);
+    const BitboardPair goldMovers = own & BitboardPair(goldMover, goldMover);
+    const BitboardPair silvers    = own & BitboardPair(pieceMaps[SILVER_GENERAL] & unpromoted, pieceMaps[SILVER_GENERAL] & unpromoted);
+    const BitboardPair knights    = own & BitboardPair(pieceMaps[KNIGHT] & unpromoted, pieceMaps[KNIGHT] & unpromoted);
+    const BitboardPair pawns      = own & BitboardPair(pieceMaps[PAWN] & unpromoted, pieceMaps[PAWN] & unpromoted);
+    const BitboardPair kings      = own & BitboardPair(pieceMaps[KING], pieceMaps[KING]);
+
+    // Steps are given for player one, for whom forward is towards the lower squares, and mirrored for player two
+    int count = 0;
+    sets[count++] = pawns.step(-9);
+    sets[count++] = knights.step(-19);
+    sets[count++] = knights.step(-17);
+    for (int delta : {-10, -9, -8})
+    {
+        sets[count++] = (goldMovers | silvers).step(delta);
+    }
+    for (int delta : {-1, 1, 9})
+    {
+        sets[count++] = goldMovers.step(delta);
+    }
+    sets[count++] = silvers.step(8);
+    sets[count++] = silvers.step(10);
+    for (int delta : {-10, -9, -8, -1, 1, 8, 9, 10})
+    {
+        sets[count++] = kings.step(delta);
+    }
+
+    // Rooks, bishops and lances, promoted rooks and bishops take their steps along. The sliders of the two
+    // players are paired up in order
+    const Bitboard slider = pieceMaps[ROOK] | pieceMaps[BISHOP] | (pieceMaps[LANCE] & unpromoted);
+    Bitboard sliders[2] = {own[0] & slider, own[1] & slider};
+    while (sliders[0] || sliders[1])
+    {
+        Bitboard attacks[2];
+        for (int player = 0; player < 2; player++)
+        {
+            if (sliders[player])
+            {
+                const int square = sliders[player].BSF();
+                sliders[player].removeLSB();
+                attacks[player] = attackMap(mailbox[square], square, empty, player);
+            }
+        }
+        sets[count++] = BitboardPair(attacks[0], attacks[1]);
+    }
+    return count;
+}
+
+// Squares attacked by at least one piece of the player
+Bitboard Position::attackedSquares(bool player, const Bitboard& empty) const
+{
+    BitboardPair sets[32];
+    const int count = attackSets(empty, sets);
+    BitboardPair attacked;
+    for (int i = 0; i < count; i++)
+    {
+        attacked |= sets[i];
+    }
+    return attacked[player];
+}
+
+// Adds value to the bytes of the squares of a bitboard, sixteen squares per step
+static void addToSquares(uint8_t (&bytes)[96], const Bitboard& squares, uint8_t value)
+{
+    uint64_t bits[2];
+    squares.toConsecutive(bits);
+    const __m128i selector = _mm_set_epi8((char) 128, 64, 32, 16, 8, 4, 2, 1, (char) 128, 64, 32, 16, 8, 4, 2, 1);
+    const __m128i addend   = _mm_set1_epi8(value);
+    for (int i = 0; i < 6; i++)
+    {
+        // Copy the low byte of the sixteen bits into bytes 0 to 7 and the high byte into bytes 8 to 15
+        __m128i spread = _mm_cvtsi32_si128((int) ((bits[i >> 2] >> (16 * (i & 3))) & 0xFFFF));
+        spread = _mm_unpacklo_epi8(spread, spread);
+        spread = _mm_unpacklo_epi16(spread, spread);
+        spread = _mm_unpacklo_epi32(spread, spread);
+        const __m128i set = _mm_cmpeq_epi8(_mm_and_si128(spread, selector), selector);
+        __m128i* target = (__m128i*) (bytes + 16 * i);
+        _mm_storeu_si128(target, _mm_add_epi8(_mm_loadu_si128(target), _mm_and_si128(set, addend)));
+    }
+}
+
+// Attack counts from scratch, the attack sets are added up in four bit planes before they are spread over the squares
+void Position::loadEffect(uint8_t (&effect)[2][96]) const
+{
+    const Bitboard empty = ~occupancy() & Bitboard(true);
+    BitboardPair sets[32];
+    const int count = attackSets(empty, sets);
+    // Plane k holds bit k of the counts. A carry-save adder folds two sets into the ones plane at a time
+    // and its carries ripple through the higher planes, ten attackers is the most a square can have
+    BitboardPair planes[4];
+    sets[count] = BitboardPair();
+    for (int i = 0; i < count; i += 2)
+    {
+        const BitboardPair partial = planes[0] ^ sets[i];
+        BitboardPair carry = (planes[0] & sets[i]) | (partial & sets[i + 1]);
+        planes[0] = partial ^ sets[i + 1];
+        for (int bit = 1; bit < 4; bit++)
+        {
+            const BitboardPair next = planes[bit] & carry;
+            planes[bit] ^= carry;
+            carry = next;
+        }
+    }
+    for (int player = 0; player < 2; player++)
+    {
+        for (int square = 0; square < 96; square++)
+        {
+            effect[player][square] = 0;
+        }
+        for (int bit = 0; bit < 4; bit++)
+        {
+            addToSquares(effect[player], planes[bit][player], 1 << bit);
+        }
+    }
+}
+
+// Adds delta to the attack counts of every square attacked by the pieces
+void Position::updateEffect(uint8_t (&effect)[2][96], Bitboard pieces, const Bitboard& empty, int delta) const
+{
+    while (pieces)
+    {
+        const int square = pieces.BSF();
+        pieces.removeLSB();
+        const bool player = pieceMaps[8] & squareMask[square];
+        const Bitboard attacks = attackMap(mailbox[square], square, empty, player);
+        for (uint64_t bits = attacks.p[0]; bits; bits &= bits - 1)
+        {
+            effect[player][__builtin_ctzll(bits)] += delta;
+        }
+        for (uint64_t bits = attacks.p[1]; bits; bits &= bits - 1)
+        {
+            effect[player][63 + __builtin_ctzll(bits)] += delta;
+        }
+    }
+}
+
+// Squares attacked by at least count pieces of the player, sixteen squares per comparison
+Bitboard Position::effectAtLeast(bool player, int count) const
+{
+    const uint8_t* effect = history.back().effect[player];
+    const __m128i threshold = _mm_set1_epi8(count - 1);
+    uint64_t masks[6];
+    for (int i = 0; i < 6; i++)
+    {
+        masks[i] = _mm_movemask_epi8(_mm_cmpgt_epi8(_mm_loadu_si128((const __m128i*) (effect + 16 * i)), threshold));
+    }
+    const uint64_t low  = masks[0] | masks[1] << 16 | masks[2] << 32 | masks[3] << 48;
+    const uint64_t high = masks[4] | masks[5] << 16;
+    return Bitboard::fromConsecutive(low, high);
+}
+
+// Squares attacked by at least count pieces, for both players at once
+BitboardPair Position::effectAtLeast(int count) const
+{
+#ifdef __AVX2__
+    const uint8_t (&effect)[2][96] = history.back().effect;
+    const __m256i threshold = _mm256_set1_epi8(count - 1);
+    uint64_t masks[2][6];
+    for (int i = 0; i < 6; i++)
+    {
+        // Sixteen squares of player two in the low lane and the same squares of player one in the high lane
+        const __m256i counts = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*) (effect[0] + 16 * i))),
+                                                       _mm_loadu_si128((const __m128i*) (effect[1] + 16 * i)), 1);
+        const uint32_t mask = _mm256_movemask_epi8(_mm256_cmpgt_epi8(counts, threshold));
+        masks[0][i] = mask & 0xFFFF;
+        masks[1][i] = mask >> 16;
+    }
+    Bitboard boards[2];
+    for (int player = 0; player < 2; player++)
+    {
+        const uint64_t low  = masks[player][0] | masks[player][1] << 16 | masks[player][2] << 32 | masks[player][3] << 48;
+        const uint64_t high = masks[player][4] | masks[player][5] << 16;
+        boards[player] = Bitboard::fromConsecutive(low, high);
+    }
+    return BitboardPair(boards[0], boards[1]);
+#else
+    return BitboardPair(effectAtLeast(false, count), effectAtLeast(true, count));
+#endif
+}
+
+// Whether the side to move is attacked on its king square
+bool Position::checked() const
+{
+    const int kingSquare = (pieceMaps[KING] & sideOccupancy(playerOne)).BSF();
+    return history.back().effect[!playerOne][kingSquare] != 0;
+}
+
+// Looks back to the last irreversible move for an earlier occurrence of the position. A repetition inside the
+// search tree is scored at once, before the root the position must have occurred three times (sennichite).
+Repetition Position::repetition(int plies) const
+{
+    const int current = history.size() - 1;
+    const int end     = std::min(history[current].reversiblePlies, current);
+    int occurrences = 0;
+    for (int i = 4; i <= end; i += 2)
+    {
+        if (history[current - i].key != key || (i >= plies && ++occurrences < 3))
+        {
+            continue;
+        }
+        // Perpetual check if every position of the cycle after a move of that side is a check
+        bool theirChecks = true;
+        bool ourChecks   = true;
+        for (int j = 0; j < i; j++)
+        {
+            if (j % 2 == 0)
+            {
+                theirChecks &= history[current - j].inCheck;
+            }
+            else
+            {
+                ourChecks &= history[current - j].inCheck;
+            }
+        }
+        return theirChecks ? REPETITION_WIN : ourChecks ? REPETITION_LOSS : REPETITION_DRAW;
+    }
+    return REPETITION_NONE;
+}
+
+// Whether the side to move has a reversible move back to a position that occurred earlier in the search tree
+bool Position::upcomingRepetition(int plies) const
+{
+    const int current = history.size() - 1;
+    const int end     = std::min(std::min(history[current].reversiblePlies, current), plies - 1);
+    if (end < 3)
+    {
+        return false;
+    }
+    const Bitboard empty = ~occupancy() & Bitboard(true);
+    bool ourChecks = true;
+    for (int i = 3; i <= end; i += 2)
+    {
+        // Repeating by checking every move would lose, the repeating move itself lands on history[current - i]
+        ourChecks &= history[current - i + 2].inCheck;
+        const uint64_t moveKey = key ^ history[current - i].key;
+        int slot = cuckooFirstHash(moveKey);
+        if (cuckooKey[slot] != moveKey)
+        {
+            slot = cuckooSecondHash(moveKey);
+            if (cuckooKey[slot] != moveKey)
+            {
+                continue;
+            }
+        }
+        // The squares between the origin and destination must be empty and the piece must be ours
+        const Move move = cuckooMove[slot];
+        const int square = (empty & squareMask[move.from()]) ? move.to() : move.from();
+        if ((attackMap(move.movedPiece(), move.from(), empty, playerOne) & squareMask[move.to()]) &&
+            (sideOccupancy(playerOne) & squareMask[square]) && !(ourChecks && history[current - i].inCheck))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Attack counts saturated at 3 as two bitboards per player, player one in out[0] and out[1]
 void Position::kikiBitboards(Bitboard (&out)[4]) const {
-    const Bitboard occupied = pieceMaps[0] | pieceMaps[1] | pieceMaps[2] | pieceMaps[3] |
-                              pieceMaps[4] | pieceMaps[5] | pieceMaps[6] | pieceMaps[7];
-    const Bitboard empty = ~occupied     & Bitboard(true);
-    Bitboard player_one  =  pieceMaps[8];
-    Bitboard player_two  = ~pieceMaps[8] & occupied;
-
-    Bitboard kiki;
-    while (player_one)
-    {
-        int square = player_one.BSF();
-        player_one.removeLSB();
-        uint8_t piece = mailbox[square];
-        kiki = attackMap(piece, square, empty, true);
-
-        out[0] ^= kiki & ~(out[0] & out[1]);
-        out[1] ^= kiki & (~out[0]) & (~out[1]);
-    }
-/*
-    (~out[0] & ~out[1]).print();
-    (out[0] & ~out[1]).print();
-    (~out[0] & out[1]).print();
-    (out[0] & out[1]).print();
-*/
-    while (player_two)
-    {
-        int square = player_two.BSF();
-        player_two.removeLSB();
-        uint8_t piece = mailbox[square];
-        kiki = attackMap(piece, square, empty, false);
-
-        out[2] ^= kiki & ~(out[2] & out[3]);
-        out[3] ^= kiki & (~out[2]) & (~out[3]);
-    }
-/*
-    (~out[2] & ~out[3]).print();
-    (out[2] & ~out[3]).print();
-    (~out[2] & out[3]).print();
-    (out[2] & out[3]).print();*/
+    const BitboardPair twice = effectAtLeast(2);
+    const BitboardPair odd   = effectAtLeast(1).andNot(twice) | effectAtLeast(3);
+    out[0] = odd[1];
+    out[1] = twice[1];
+    out[2] = odd[0];
+    out[3] = twice[0];
 }
@@ -1,7 +1,9 @@
 #ifndef POSITION_H_INCLUDED
 #define POSITION_H_INCLUDED
 
+#include <vector>
 #include "bitboard.h"
+#include "nnue.h"
 
 
 constexpr int PIECE_HAND_LOCATION[8] = {0, 0, 4, 8, 12, 16, 20, 24};
@@ -26,6 +28,13 @@ constexpr int hand_count(Hand hand, int piece) { return (int)(hand >> PIECE_HAND
 
 const int DROP_SQUARE = 81;
 
+// Zobrist keys, indexed by player (1 for player one), piece and square or hand count
+extern uint64_t zobristPiece[2][16][81];
+extern uint64_t zobristHand[2][8][19];
+extern uint64_t zobristSide;
+
+void initialiseZobrist();
+
 struct Move {
     int value;
 
@@ -74,16 +83,70 @@ struct Move {
 
 };
 
+// Cuckoo hash of the reversible moves, keyed by the difference of the position keys before and after the move
+const int CUCKOO_SIZE = 16384;
+extern uint64_t cuckooKey[CUCKOO_SIZE];
+extern Move cuckooMove[CUCKOO_SIZE];
+
+// State that cannot be recovered from the board, kept for every ply of the game and the search
+struct StateInfo {
+    uint64_t key;
+    // Plies since the last capture, drop, promotion or move of a piece that cannot move back
+    int reversiblePlies;
+    // The side to move is in check
+    bool inCheck;
+    // Fixed-point material, piece-square and hand terms of the evaluation, updated by makeMove
+    int material;
+    // Number of pieces of each player (1 for player one) attacking each square, padded to whole 16-byte loads
+    uint8_t effect[2][96];
+};
+
+// Outcome of a repetition for the side to move, perpetual check loses for the checking side
+enum Repetition {REPETITION_NONE, REPETITION_DRAW, REPETITION_WIN, REPETITION_LOSS};
+
 struct Position {
     bool playerOne = true;
     Hand hand[2] = {EMPTY_HAND, EMPTY_HAND};
     // The bitboards represent: king, rook, bishop, gold general, silver general, Knight, lance, pawns, color, promoted
     Bitboard pieceMaps[10];
     uint8_t mailbox[81] = {0};
+    uint64_t key = 0;
+    std::vector<StateInfo> history;
+    // Network accumulators for every ply of history, empty when the network does not evaluate
+    std::vector<Accumulator> accumulators;
+
+    Bitboard occupancy() const
+    {
+        return pieceMaps[0] | pieceMaps[1] | pieceMaps[2] | pieceMaps[3] |
+               pieceMaps[4] | pieceMaps[5] | pieceMaps[6] | pieceMaps[7];
+    }
+    // Pieces of player one (true) or player two (false)
+    Bitboard sideOccupancy(bool player) const
+    {
+        return (player ? pieceMaps[8] : occupancy() ^ pieceMaps[8]);
+    }
+
+    bool inCheck() const
+    {
+        return history.back().inCheck;
+    }
 
+    Bitboard attackersTo(int square, const Bitboard& occupied) const;
+    Bitboard slidersTo(int square, const Bitboard& empty) const;
+    int attackSets(const Bitboard& empty, BitboardPair (&sets)[32]) const;
+    Bitboard attackedSquares(bool player, const Bitboard& empty) const;
+    void loadEffect(uint8_t (&effect)[2][96]) const;
+    void updateEffect(uint8_t (&effect)[2][96], Bitboard pieces, const Bitboard& empty, int delta) const;
+    Bitboard effectAtLeast(bool player, int count) const;
+    BitboardPair effectAtLeast(int count) const;
+    bool checked() const;
+    Repetition repetition(int plies) const;
+    bool upcomingRepetition(int plies) const;
     void kikiBitboards(Bitboard (&out)[4]) const;
     void loadInitial();
     void loadMailbox();
+    void loadKey();
+    void resetHistory();
     void loadSFEN(const char* sfen);
     void createSFEN();
     std::string regularFormat() const;
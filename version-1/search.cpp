@@ -1,148 +1,732 @@
 #include <iostream>
+#include <cstdlib>
+#include <atomic>
+#include <vector>
+#include <algorithm>
 
 #include "moveGenerator.h"
 #include "position.h"
 #include "learner.h"
 #include "random.h"
+#include "search.h"
+#include "transposition.h"
 
 // Constants
 const int INF = 10000;
 const int MVV_LVA[16] = {0, 11, 9, 8, 7, 5, 3, 1, 0, 23, 18, 0, 11, 9, 11, 10};
 const int captureValue[16] = {0, 165, 135, 122, 106, 62, 56, 23, 0, 217, 173, 0, 113, 81, 83, 65};
-
-// Timing
-int start_time;
+const int MAX_PLY = 100;
+// Scores beyond this bound are mate scores, which are stored in the transposition table relative to the node
+const int MATE_BOUND = INF - 100 - MAX_PLY;
+const int HISTORY_MAX = 16384;
+// Captures per node that a cutoff can punish in the capture history
+const int MAX_TRACKED_CAPTURES = 32;
+const int MAX_MULTI_PV = 64;
+// Slack for positional gains when delta pruning captures in the quiescence search
+const int DELTA_MARGIN = 50;
+// A capture must beat beta by this margin in a reduced search to cut the node
+const int PROBCUT_MARGIN = 40;
+
+// Timing, start_time is reset on a ponderhit and zero limits mean no limit
+std::atomic<int> start_time(0);
 int last_time;
 int max_time;
+uint64_t max_nodes = 0;
+std::atomic<bool> stopSearch(false);
+std::atomic<bool> pondering(false);
 
 // Stats
 uint64_t search_count = 0;
 uint64_t evaluations = 0;
-uint64_t ply_sum = 0;
-uint64_t historyHeuristic[16][81][81] = {0};
+uint64_t quiescence_count = 0;
+int selDepth = 0;
+
+// Search statistics, compiled in with -DSEARCH_STATS and printed as JSON after every search
+#ifdef SEARCH_STATS
+#define STATS(statement) statement
+struct SearchStats {
+    uint64_t nodesPerPly[MAX_PLY];
+    // Nodes searched up to the end of each iteration
+    uint64_t iterationNodes[31];
+    int iterations;
+    uint64_t failHighs, failHighsFirst;
+    uint64_t ttProbes, ttHits, ttCutoffs, ttStores, ttOverwrites;
+    uint64_t mateDistancePrunes, repetitions, upcomingRepetitions;
+    uint64_t probCuts, multiCuts, iidSearches, iirReductions;
+    uint64_t checkExtensions, singularExtensions;
+    uint64_t standPatCutoffs, deltaPrunes, seePrunes;
+    // Evaluations that stopped at the material terms above beta or below alpha
+    uint64_t lazyHigh, lazyLow;
+};
+SearchStats stats;
+#else
+#define STATS(statement)
+#endif
+
+// Move ordering, the history tables are indexed by moved piece and destination (butterfly also by origin, 81 for drops)
+// The quiet move tables are also indexed by the side to move, as movedPiece() carries no colour
+Move killerMoves[MAX_PLY][2];
+Move counterMoves[2][16][81];
+int16_t historyHeuristic[2][16][82][81] = {0};
+// Continuation history per ply offset: [0] follows the opponent's last move, [1] the side's own move before it
+int16_t continuationHistory[2][2][16][81][16][81] = {0};
+int16_t captureHistory[16][81][8] = {0};
 
 // Move generation
-moveList moveListStack[100];
+moveList moveListStack[MAX_PLY];
+Move playedMoves[MAX_PLY];
 Move globalBestMove;
 
+// Principal variation, pvTable[p] holds the best line found from ply p onwards
+Move pvTable[MAX_PLY][MAX_PLY];
+int pvLength[MAX_PLY];
+Move previousPV[MAX_PLY];
+int previousPVLength = 0;
+bool followPV = false;
+
+// Root moves keep their order between iterations: the best lines first, then by the score of the last iteration
+// (-INF unless the move raised alpha), then the moves with the largest subtrees
+struct RootMove {
+    Move move;
+    int score;
+    uint64_t nodes;
+};
+std::vector<RootMove> rootMoves;
+// Index of each root move in rootMoves, by origin, destination and promotion or dropped piece
+int16_t rootMoveSlots[82][81][8];
+
+// MultiPV, line k is searched with the first moves of lines 0 to k - 1 excluded at the root
+int multiPV = 1;
+int multiPVCount = 0;
+Move multiPVLines[MAX_MULTI_PV][MAX_PLY];
+int multiPVLengths[MAX_MULTI_PV];
+int multiPVScores[MAX_MULTI_PV];
+
+// Extensions
+int rootDepth;
+int pathExtensions[MAX_PLY];
+Move excludedMoves[MAX_PLY];
+
 // Function declarations
 int negamax(Position& node, int depth, int plies, int alpha, int beta);
 int quiescence(Position& node, int plies, int qsPlies, int alpha, int beta);
 
-void engineMove (Position& pos, int timeAllowance) {
-    pos.print();
+// Draw by repetition, or a mate score for the side that gives perpetual check
+inline int repetitionScore(Repetition repetition, int plies) {
+    return repetition == REPETITION_WIN ? INF - 100 - plies - 1 : repetition == REPETITION_LOSS ? -INF + 100 + plies : 0;
+}
+
+#ifdef SEARCH_STATS
+inline void countStore(const TTEntry* entry, uint64_t key) {
+    stats.ttStores++;
+    stats.ttOverwrites += entry->bound != BOUND_NONE && entry->key32 != (uint32_t) (key >> 32);
+}
+
+inline double ratio(uint64_t numerator, uint64_t denominator) {
+    return denominator != 0 ? (double) numerator / denominator : 0.0;
+}
+
+void printStats() {
+    const uint64_t nodes = search_count + quiescence_count;
+    int plies = MAX_PLY;
+    while (plies > 0 && stats.nodesPerPly[plies - 1] == 0) {
+        plies--;
+    }
+    std::cout << "info string stats {\"nodes\":" << nodes << ",\"mainNodes\":" << search_count
+              << ",\"qsearchNodes\":" << quiescence_count << ",\"evaluations\":" << evaluations << ",\"nodesPerPly\":[";
+    for (int p = 0; p < plies; p++) {
+        std::cout << (p != 0 ? "," : "") << stats.nodesPerPly[p];
+    }
+    // Growth of the last iteration over the one before it
+    const int last = stats.iterations;
+    const double branchingFactor = last >= 2 ? ratio(stats.iterationNodes[last] - stats.iterationNodes[last - 1],
+                                                     stats.iterationNodes[last - 1] - stats.iterationNodes[last - 2]) : 0.0;
+    std::cout << "],\"branchingFactor\":" << branchingFactor
+              << ",\"failHighs\":" << stats.failHighs << ",\"failHighFirstRate\":" << ratio(stats.failHighsFirst, stats.failHighs)
+              << ",\"tt\":{\"probes\":" << stats.ttProbes << ",\"hitRate\":" << ratio(stats.ttHits, stats.ttProbes)
+              << ",\"cutoffs\":" << stats.ttCutoffs << ",\"stores\":" << stats.ttStores
+              << ",\"overwriteRate\":" << ratio(stats.ttOverwrites, stats.ttStores) << "}"
+              << ",\"lazyEval\":{\"high\":" << stats.lazyHigh << ",\"low\":" << stats.lazyLow
+              << ",\"rate\":" << ratio(stats.lazyHigh + stats.lazyLow, evaluations)
+              << ",\"swing\":" << kikiSwing * 100 / EVAL_ONE << "}"
+              << ",\"pruning\":{\"mateDistance\":" << stats.mateDistancePrunes << ",\"repetition\":" << stats.repetitions
+              << ",\"upcomingRepetition\":" << stats.upcomingRepetitions << ",\"probCut\":" << stats.probCuts
+              << ",\"multiCut\":" << stats.multiCuts << ",\"standPat\":" << stats.standPatCutoffs
+              << ",\"delta\":" << stats.deltaPrunes << ",\"see\":" << stats.seePrunes << "}"
+              << ",\"reductions\":{\"iir\":" << stats.iirReductions << "},\"iid\":" << stats.iidSearches
+              << ",\"extensions\":{\"check\":" << stats.checkExtensions << ",\"singular\":" << stats.singularExtensions << "}}"
+              << std::endl;
+}
+#endif
+
+// Neither the time nor the node budget runs out while pondering
+inline bool budgetSpent() {
+    return !pondering && ((max_time != 0 && last_time - start_time > max_time) ||
+                          (max_nodes != 0 && search_count + quiescence_count >= max_nodes));
+}
+
+inline int16_t& rootMoveSlot(const Move& move) {
+    return rootMoveSlots[move.from()][move.to()][move.isDrop() ? move.movedType() : move.isPromotion()];
+}
+
+inline int rootMoveIndex(const Move& move) {
+    return rootMoveSlot(move);
+}
+
+inline bool reportedInMultiPV(const Move& move) {
+    for (int line = 0; line < multiPVCount; line++) {
+        if (move.value == multiPVLines[line][0].value) {
+            return true;
+        }
+    }
+    return false;
+}
+
+inline int scoreToTT(int score, int plies) {
+    return score >= MATE_BOUND ? score + plies : score <= -MATE_BOUND ? score - plies : score;
+}
+
+inline int scoreFromTT(int score, int plies) {
+    return score >= MATE_BOUND ? score - plies : score <= -MATE_BOUND ? score + plies : score;
+}
+
+// Gravity update, the entry saturates towards +-HISTORY_MAX so no decay pass is needed
+inline void updateHistory(int16_t& entry, int bonus) {
+    bonus = std::max(-HISTORY_MAX, std::min(HISTORY_MAX, bonus));
+    entry += bonus - entry * std::abs(bonus) / HISTORY_MAX;
+}
+
+inline int historyBonus(int depth) {
+    return std::min(1600, 32 * (depth / 100) * (depth / 100));
+}
+
+inline int quietScore(const Move& move, int plies, bool playerOne) {
+    int score = historyHeuristic[playerOne][move.movedPiece()][move.from()][move.to()];
+    if (plies >= 1) {
+        score += continuationHistory[playerOne][0][playedMoves[plies - 1].movedPiece()][playedMoves[plies - 1].to()][move.movedPiece()][move.to()];
+    }
+    if (plies >= 2) {
+        score += continuationHistory[playerOne][1][playedMoves[plies - 2].movedPiece()][playedMoves[plies - 2].to()][move.movedPiece()][move.to()];
+    }
+    return score;
+}
+
+void updateQuietHistories(const Move& move, int plies, bool playerOne, int bonus) {
+    updateHistory(historyHeuristic[playerOne][move.movedPiece()][move.from()][move.to()], bonus);
+    if (plies >= 1) {
+        updateHistory(continuationHistory[playerOne][0][playedMoves[plies - 1].movedPiece()][playedMoves[plies - 1].to()][move.movedPiece()][move.to()], bonus);
+    }
+    if (plies >= 2) {
+        updateHistory(continuationHistory[playerOne][1][playedMoves[plies - 2].movedPiece()][playedMoves[plies - 2].to()][move.movedPiece()][move.to()], bonus);
+    }
+}
+
+// Most valuable victim first, refined by how often the capture caused a cutoff
+inline int captureScore(const Move& move) {
+    return 8 * captureValue[move.capturedPiece()] - MVV_LVA[move.movedPiece()] + 80 * move.isPromotion()
+         + (move.isCapture() ? captureHistory[move.movedPiece()][move.to()][move.capturedType()] / 16 : 0);
+}
+
+// Reward the capture that caused a cutoff and punish the captures searched before it
+void updateCaptureHistories(const Move& cutoffMove, const Move* searched, int searchedCount, int bonus) {
+    if (cutoffMove.isCapture()) {
+        updateHistory(captureHistory[cutoffMove.movedPiece()][cutoffMove.to()][cutoffMove.capturedType()], bonus);
+    }
+    for (int j = 0; j < searchedCount; j++) {
+        const Move& tried = searched[j];
+        updateHistory(captureHistory[tried.movedPiece()][tried.to()][tried.capturedType()], -bonus);
+    }
+}
+
+// Forgets everything learned from earlier searches except the transposition table
+void clearSearchHistory() {
+    std::fill(&killerMoves[0][0], &killerMoves[0][0] + MAX_PLY * 2, Move());
+    std::fill(&counterMoves[0][0][0], &counterMoves[0][0][0] + 2 * 16 * 81, Move());
+    std::fill(&historyHeuristic[0][0][0][0], &historyHeuristic[0][0][0][0] + 2 * 16 * 82 * 81, 0);
+    std::fill(&continuationHistory[0][0][0][0][0][0], &continuationHistory[0][0][0][0][0][0] + 2 * 2 * 16 * 81 * 16 * 81, 0);
+    std::fill(&captureHistory[0][0][0], &captureHistory[0][0][0] + 16 * 81 * 8, 0);
+}
+
+uint64_t searchedNodes() {
+    return search_count + quiescence_count;
+}
+
+// USI info line of a completed iteration, the score is from the side to move
+void printInfo(int depth, int line) {
+    const int time = getTime() - start_time;
+    const uint64_t nodes = search_count + quiescence_count;
+    const int score = multiPVScores[line];
+    std::cout << "info depth " << depth / 100 << " seldepth " << selDepth;
+    if (multiPV > 1) {
+        std::cout << " multipv " << line + 1;
+    }
+    std::cout << " score ";
+    if (score >= MATE_BOUND) {
+        std::cout << "mate " << INF - 100 - score;
+    }
+    else if (score <= -MATE_BOUND) {
+        std::cout << "mate -" << score + INF - 100;
+    }
+    else {
+        std::cout << "cp " << score;
+    }
+    std::cout << " nodes " << nodes << " nps " << (time > 0 ? nodes * 1000 / time : 0) << " time " << time
+              << " hashfull " << hashfull() << " pv";
+    for (int p = 0; p < multiPVLengths[line]; p++) {
+        std::cout << " " << multiPVLines[line][p];
+    }
+    std::cout << std::endl;
+}
+
+// Iterative deepening, prints an info line per completed iteration and returns the best move with the expected reply
+Move think(Position& pos, const SearchLimits& limits, Move& ponderMove) {
     /* initialize root */
-    max_time = timeAllowance;
-    int score;
+    max_time = limits.maxTime;
+    max_nodes = limits.nodes;
     start_time = getTime();
-    Move computerMove;
+    search_count  = 0;
+    evaluations   = 0;
+    quiescence_count = 0;
+    STATS(stats = SearchStats());
+    newSearchGeneration();
+    // Room for every ply the search can add, loaded positions keep only the game history
+    pos.history.reserve(pos.history.size() + MAX_PLY);
+    if (!pos.accumulators.empty()) {
+        pos.accumulators.reserve(pos.accumulators.size() + MAX_PLY);
+    }
+    for (int p = 0; p < MAX_PLY; ++p) {
+        killerMoves[p][0] = Move();
+        killerMoves[p][1] = Move();
+    }
+    previousPVLength = 0;
+    // The best move of the previous search must not leak into this one
+    globalBestMove = Move();
+    const moveList legalMoves = generateMoves(pos);
+    rootMoves.clear();
+    // Without a legal move the side to move is mated, there is nothing to search and no root move to time
+    ponderMove = Move();
+    if (legalMoves.size == 0) {
+        return Move();
+    }
+    for (int i = 0; i < legalMoves.size; i++) {
+        rootMoves.push_back({legalMoves.moveList[i], -INF, 0});
+    }
+    const int lines = std::min(std::min(multiPV, MAX_MULTI_PV), legalMoves.size);
+    const int maxDepth = limits.depth != 0 ? std::min(100 * limits.depth, 3000) : 3000;
+    // Fall back on any legal move if not even the first iteration completes
+    Move bestMove = legalMoves.moveList[0];
+    int stableIterations = 0;
     // do search
-    for (int i = 100; i <= 3000; i += 100) {
-
-        score = negamax(pos, i, 0, -INF, INF);
+    for (int i = 100; i <= maxDepth; i += 100) {
+
+        rootDepth = i;
+        selDepth = 0;
+        if (i > 100) {
+            std::stable_sort(rootMoves.begin(), rootMoves.end(), [lines](const RootMove& a, const RootMove& b) {
+                int lineA = lines;
+                int lineB = lines;
+                for (int line = 0; line < lines; line++) {
+                    lineA = a.move.value == multiPVLines[line][0].value ? line : lineA;
+                    lineB = b.move.value == multiPVLines[line][0].value ? line : lineB;
+                }
+                return lineA != lineB ? lineA < lineB : a.score != b.score ? a.score > b.score : a.nodes > b.nodes;
+            });
+        }
+        for (int m = 0; m < (int) rootMoves.size(); m++) {
+            rootMoveSlot(rootMoves[m].move) = m;
+            rootMoves[m].score = -INF;
+            rootMoves[m].nodes = 0;
+        }
+        for (multiPVCount = 0; multiPVCount < lines; multiPVCount++) {
+            pathExtensions[0] = 0;
+            followPV = multiPVCount == 0;
+            multiPVScores[multiPVCount] = negamax(pos, i, 0, -INF, INF);
+            if (stopSearch) {
+                break;
+            }
+            multiPVLengths[multiPVCount] = pvLength[0];
+            for (int p = 0; p < pvLength[0]; p++) {
+                multiPVLines[multiPVCount][p] = pvTable[0][p];
+            }
+        }
+        multiPVCount = 0;
+        if (stopSearch) break;
+        // search output
+        for (int line = 0; line < lines; line++) {
+            printInfo(i, line);
+        }
+        STATS(stats.iterationNodes[i / 100] = searchedNodes());
+        STATS(stats.iterations = i / 100);
+        stableIterations = globalBestMove.value == bestMove.value ? stableIterations + 1 : 0;
+        bestMove.value = globalBestMove.value;
+
+        // The principal variation is searched first in the next iteration
+        previousPVLength = multiPVLengths[0];
+        for (int p = 0; p < multiPVLengths[0]; p++) {
+            previousPV[p] = multiPVLines[0][p];
+        }
         last_time = getTime();
-        int time = last_time - start_time;
+        if (budgetSpent()) break;
 
-        if (time > timeAllowance) break;
-        // search output
+        // Stop early when the best move stays the same and takes most of the effort, take longer when it changes
+        uint64_t iterationNodes = 0;
+        for (const RootMove& rootMove : rootMoves) {
+            iterationNodes += rootMove.nodes;
+        }
+        const double bestMoveEffort = (double) rootMoves[rootMoveIndex(bestMove)].nodes / std::max<uint64_t>(1, iterationNodes);
+        const double timeScale = (1.5 - 0.2 * std::min(stableIterations, 4)) * (1.5 - bestMoveEffort);
+        if (!pondering && limits.time != 0 && last_time - start_time > limits.time * timeScale) break;
+    }
 
-        std::cout<<"Depth("<< (double) (10 * ply_sum / (evaluations + 1)) / 10 <<")\tEval: " << (pos.playerOne ? score : -score) <<"    \t"<< (double) time / 1000 <<" sec\t";
-        if (time % 100 == 0) {
-            std::cout<<"\t";
+    // The reply to ponder on is the second move of the principal variation, or the hash move after the best move
+    ponderMove = Move();
+    if (previousPVLength > 1 && previousPV[0].value == bestMove.value) {
+        ponderMove = previousPV[1];
+    }
+    else if (bestMove.value != 0) {
+        pos.makeMove(bestMove);
+        bool ttHit;
+        TTEntry* ttEntry = probeTransposition(pos.key, ttHit);
+        moveList replies = generateMoves(pos);
+        for (int i = 0; ttHit && i < replies.size; i++) {
+            if (replies.moveList[i].value == ttEntry->move) {
+                ponderMove = replies.moveList[i];
+            }
         }
-        std::cout << globalBestMove << "\n";
-        computerMove.value = globalBestMove.value;
+        pos.undoMove(bestMove);
     }
+    STATS(printStats());
+    return bestMove;
+}
+
+// Plays a move after thinking for a fixed time, used for games in the console
+void engineMove (Position& pos, int timeAllowance) {
+    pos.print();
+    SearchLimits limits;
+    limits.maxTime = timeAllowance;
+    stopSearch = false;
+    pondering = false;
+    Move ponderMove;
+    Move computerMove = think(pos, limits, ponderMove);
     // play move
     pos.makeMove(computerMove);
     // statistic output
     std::cout << "Thinking time      \t" << getTime() - start_time << "ms\n";
     std::cout << "Search calls:      \t" << search_count    << "\n";
+    std::cout << "Quiescence calls:  \t" << quiescence_count << "\n";
     std::cout << "Evaluation calls:  \t" << evaluations     << "\n";
     std::cout << "Speed (leaf nodes):\t" << evaluations / timeAllowance << " Kn/s\n";
-    // reset statistics
-    search_count  = 0;
-    evaluations   = 0;
-    ply_sum       = 0;
-    for (int p = 0; p < 16; ++p)
-        for (int f = 0; f < 81; ++f)
-            for (int t = 0; t < 81; ++t)
-                historyHeuristic[p][f][t] /= 8;
 }
 
 
 
 int negamax(Position& node, int depth, int plies, int alpha, int beta) {
+    pvLength[plies] = plies;
 
     if ((search_count & 8191)== 0) {
         last_time = getTime();
-        if (last_time - start_time > max_time) {
+        if (budgetSpent()) {
             // kill the search
-            return 0;
+            stopSearch = true;
         }
     }
+    if (stopSearch) {
+        return 0;
+    }
     search_count++;
+    STATS(stats.nodesPerPly[plies]++);
 
     if (plies != 0) {
         alpha = std::max(-INF + 100 + plies, alpha);
         beta = std::min(-(-INF + 100 + plies + 1), beta);
         if (alpha >= beta) {
+            STATS(stats.mateDistancePrunes++);
             return alpha;
         }
+        const Repetition repetition = node.repetition(plies);
+        if (repetition != REPETITION_NONE) {
+            STATS(stats.repetitions++);
+            return repetitionScore(repetition, plies);
+        }
+        // A move back to an earlier position of the search draws, so the score is at least a draw
+        if (alpha < 0 && node.upcomingRepetition(plies)) {
+            STATS(stats.upcomingRepetitions++);
+            alpha = 0;
+            if (alpha >= beta) {
+                return alpha;
+            }
+        }
     }
 
 
-    if (depth <= 0 || plies > 20) {
+    if (depth <= 0 || plies >= MAX_PLY - 10) {
         return quiescence(node, plies, 0, alpha, beta);
     }
 
+    // Transposition table, skipped for the cutoff of an exclusion search because the position is the same and at
+    // nodes with an open window, whose cutoff would leave the principal variation without its continuation
+    const Move excludedMove = excludedMoves[plies];
+    bool ttHit;
+    TTEntry* ttEntry = probeTransposition(node.key, ttHit);
+    STATS(stats.ttProbes++);
+    STATS(stats.ttHits += ttHit);
+    Move ttMove;
+    int ttScore = 0;
+    if (ttHit) {
+        ttMove = ttEntry->ttMove();
+        ttScore = scoreFromTT(ttEntry->score, plies);
+        if (plies != 0 && beta - alpha == 1 && excludedMove.value == 0 && ttEntry->depth >= depth) {
+            if (ttEntry->bound == BOUND_EXACT) {
+                STATS(stats.ttCutoffs++);
+                return ttScore;
+            }
+            if (ttEntry->bound == BOUND_LOWER && ttScore >= beta) {
+                STATS(stats.ttCutoffs++);
+                return beta;
+            }
+            if (ttEntry->bound == BOUND_UPPER && ttScore <= alpha) {
+                STATS(stats.ttCutoffs++);
+                return alpha;
+            }
+        }
+    }
+
+    // ProbCut: a winning capture that beats beta by a margin in a search four plies shallower refutes the node
+    const int probCutBeta = beta + PROBCUT_MARGIN;
+    if (plies != 0 && depth >= 500 && excludedMove.value == 0 && !node.inCheck() && std::abs(beta) < MATE_BOUND &&
+        !(ttHit && ttEntry->depth >= depth - 300 && ttScore < probCutBeta)) {
+        generateTacticalMoves(node, moveListStack[plies]);
+        for (int i = 0; i < moveListStack[plies].size; i++) {
+            Move move = moveListStack[plies].moveList[i];
+            moveListStack[plies].scores[i] = move.value == ttMove.value ? (1 << 22) : captureScore(move);
+        }
+        moveListStack[plies].sortByScore();
+
+        const bool followingPV = followPV;
+        for (int i = 0; i < moveListStack[plies].size; i++) {
+            Move move = moveListStack[plies].getMove(i);
+            if (!move.isCapture() || staticExchangeValue(node, move) < 0) {
+                continue;
+            }
+            playedMoves[plies] = move;
+            pathExtensions[plies + 1] = pathExtensions[plies];
+            node.makeMove(move);
+            // The quiescence search weeds out most captures before the reduced search
+            int value = -quiescence(node, plies + 1, 0, -probCutBeta, -probCutBeta + 1);
+            if (value >= probCutBeta) {
+                value = -negamax(node, depth - 400, plies + 1, -probCutBeta, -probCutBeta + 1);
+            }
+            node.undoMove(move);
+            followPV = followingPV;
+
+            if (stopSearch) {
+                return 0;
+            }
+            if (value >= probCutBeta) {
+                STATS(countStore(ttEntry, node.key));
+                storeTransposition(ttEntry, node.key, move, scoreToTT(probCutBeta, plies), EVAL_NONE, depth - 300, BOUND_LOWER);
+                STATS(stats.probCuts++);
+                return beta;
+            }
+        }
+    }
+
+    // Internal iterative deepening and reductions: without a hash move the first moves are poor guesses, so a deep node
+    // with an open window searches shallower first to find one and any other node is searched a ply shallower
+    if (plies != 0 && ttMove.value == 0 && excludedMove.value == 0 && depth >= 400) {
+        if (beta - alpha > 1 && depth >= 1000) {
+            STATS(stats.iidSearches++);
+            const bool followingPV = followPV;
+            negamax(node, depth - 300, plies, alpha, beta);
+            followPV = followingPV;
+            pvLength[plies] = plies;
+            if (stopSearch) {
+                return 0;
+            }
+            ttEntry = probeTransposition(node.key, ttHit);
+            if (ttHit) {
+                ttMove = ttEntry->ttMove();
+                ttScore = scoreFromTT(ttEntry->score, plies);
+            }
+        }
+        else {
+            STATS(stats.iirReductions++);
+            depth -= 100;
+        }
+    }
+
+    // Singular extension: if every move but the hash move fails low against a margin below its score,
+    // the hash move is the only good move and is searched one ply deeper
+    int singularExtension = 0;
+    if (plies != 0 && depth >= 800 && ttHit && ttMove.value != 0 && excludedMove.value == 0 &&
+        (ttEntry->bound & BOUND_LOWER) && ttEntry->depth >= depth - 300 &&
+        std::abs(ttScore) < MATE_BOUND && pathExtensions[plies] + 100 <= rootDepth / 4) {
+        const int singularBeta = ttScore - depth / 50;
+        const bool followingPV = followPV;
+        excludedMoves[plies] = ttMove;
+        int value = negamax(node, (depth - 100) / 2, plies, singularBeta - 1, singularBeta);
+        excludedMoves[plies] = Move();
+        followPV = followingPV;
+        pvLength[plies] = plies;
+        if (stopSearch) {
+            return 0;
+        }
+        if (value < singularBeta) {
+            STATS(stats.singularExtensions++);
+            singularExtension = 100;
+        }
+        else if (singularBeta >= beta) {
+            // Multi-cut, another move also beats beta
+            STATS(stats.multiCuts++);
+            return beta;
+        }
+    }
+
     generateMoves(node, moveListStack[plies]);
-    int depthMin = 100;
-  /*if (moveListStack[plies].inCheck)
-    {
-        depthMin = 0;
-    }*/
      // step 7: Check for no legal moves
     if (moveListStack[plies].size == 0) {
         return -INF + 100 + plies;
     }
+    // Check extension, the extensions on a path add up to at most a quarter of the iteration depth
+    int checkExtension = 0;
+    if (moveListStack[plies].inCheck && pathExtensions[plies] + 100 <= rootDepth / 4) {
+        STATS(stats.checkExtensions++);
+        checkExtension = 100;
+    }
 
-    // order moves
+    // order moves: previous principal variation, hash move, captures and promotions, killers, countermove,
+    // then quiet moves by history
+    const bool followingPV = followPV && plies < previousPVLength;
+    Move counterMove;
+    if (plies >= 1) {
+        counterMove = counterMoves[node.playerOne][playedMoves[plies - 1].movedPiece()][playedMoves[plies - 1].to()];
+    }
     for (int i = 0; i < moveListStack[plies].size; i++)
     {
         Move move = moveListStack[plies].moveList[i];
-        int moveScore = 31 + MVV_LVA[move.capturedPiece()] - MVV_LVA[move.movedPiece()]
-                           + 10 * move.isPromotion()
-                           - 4 * move.isDrop()
-                           + (historyHeuristic[move.movedPiece()][move.from()][move.to()] >> 4);
-        moveScore = std::min(255, moveScore);
-        moveListStack[plies].moveList[i].setScore(moveScore);
+        int moveScore;
+        if (followingPV && move.value == previousPV[plies].value) {
+            moveScore = (1 << 23);
+        }
+        else if (plies == 0 && rootDepth > 100) {
+            moveScore = (1 << 22) - rootMoveIndex(move);
+        }
+        else if (move.value == ttMove.value) {
+            moveScore = (1 << 22);
+        }
+        else if (move.isCapture() || move.isPromotion()) {
+            // Losing captures are tried after the killers and countermove
+            moveScore = (move.isCapture() && staticExchangeValue(node, move) < 0 ? (1 << 18) : (1 << 20)) + captureScore(move);
+        }
+        else if (move.value == killerMoves[plies][0].value) {
+            moveScore = (1 << 19) + 2;
+        }
+        else if (move.value == killerMoves[plies][1].value) {
+            moveScore = (1 << 19) + 1;
+        }
+        else if (move.value == counterMove.value) {
+            moveScore = (1 << 19);
+        }
+        else {
+            moveScore = quietScore(move, plies, node.playerOne);
+        }
+        moveListStack[plies].scores[i] = moveScore;
     }
 
-    moveListStack[plies].sort();
+    moveListStack[plies].sortByScore();
 
+    const int alphaOriginal = alpha;
     int bestValue = -INF;
     Move bestMove;
+    // Results of a search with root moves excluded for MultiPV are not stored
+    const bool storeResult = excludedMove.value == 0 && (plies != 0 || multiPVCount == 0);
+    // Captures searched without a cutoff, the ones skipped are left out of the capture history
+    Move capturesSearched[MAX_TRACKED_CAPTURES];
+    int captureCount = 0;
+    STATS(int movesSearched = 0);
     for (int i = 0; i < moveListStack[plies].size; i++) {
         Move move = moveListStack[plies].getMove(i);
+        if (move.value == excludedMove.value || (plies == 0 && reportedInMultiPV(move))) {
+            continue;
+        }
+
+        int extension = std::max(checkExtension, move.value == ttMove.value ? singularExtension : 0);
+        pathExtensions[plies + 1] = pathExtensions[plies] + extension;
 
+        STATS(movesSearched++);
+        const uint64_t nodesBefore = search_count + quiescence_count;
+        playedMoves[plies] = move;
         node.makeMove(move);
-        int childValue = -negamax(node, depth - depthMin, plies + 1, -beta, -alpha);
+        int childValue = -negamax(node, depth - 100 + extension, plies + 1, -beta, -alpha);
         node.undoMove(move);
+        if (plies == 0) {
+            RootMove& rootMove = rootMoves[rootMoveIndex(move)];
+            rootMove.nodes += search_count + quiescence_count - nodesBefore;
+            rootMove.score = childValue > alpha ? childValue : -INF;
+        }
+        // Only the first move of a node on the principal variation continues it
+        followPV = false;
+
+        if (stopSearch) {
+            return 0;
+        }
 
         if (childValue >= beta) {
-            historyHeuristic[move.movedPiece()][move.from()][move.to()] += depth * depth >> 13;
+            STATS(stats.failHighs++);
+            STATS(stats.failHighsFirst += movesSearched == 1);
+            updateCaptureHistories(move, capturesSearched, captureCount, historyBonus(depth));
+            if (!move.isCapture() && !move.isPromotion()) {
+                int bonus = historyBonus(depth);
+                updateQuietHistories(move, plies, node.playerOne, bonus);
+                // Quiet moves searched before the cutoff move did not refute
+                for (int j = 0; j < i; j++) {
+                    Move tried = moveListStack[plies].getMove(j);
+                    if (!tried.isCapture() && !tried.isPromotion() && tried.value != excludedMove.value) {
+                        updateQuietHistories(tried, plies, node.playerOne, -bonus);
+                    }
+                }
+                if (move.value != killerMoves[plies][0].value) {
+                    killerMoves[plies][1] = killerMoves[plies][0];
+                    killerMoves[plies][0] = move;
+                }
+                if (plies >= 1) {
+                    counterMoves[node.playerOne][playedMoves[plies - 1].movedPiece()][playedMoves[plies - 1].to()] = move;
+                }
+            }
+            if (storeResult) {
+                STATS(countStore(ttEntry, node.key));
+                storeTransposition(ttEntry, node.key, move, scoreToTT(beta, plies), EVAL_NONE, depth, BOUND_LOWER);
+            }
             return beta;  // Early cutoff
         }
+        if (move.isCapture() && captureCount < MAX_TRACKED_CAPTURES) {
+            capturesSearched[captureCount++] = move;
+        }
 
         if (childValue > bestValue) {
             bestValue = childValue;
             bestMove.value = move.value & 0x00FFFFFF;  // Preserve only move part
         }
+        if (childValue > alpha) {
+            pvTable[plies][plies] = bestMove;
+            for (int p = plies + 1; p < pvLength[plies + 1]; p++) {
+                pvTable[plies][p] = pvTable[plies + 1][p];
+            }
+            pvLength[plies] = std::max(plies + 1, pvLength[plies + 1]);
+        }
 
         alpha = std::max(alpha, bestValue);
     }
-    if (plies == 0) {
+    // Only the excluded move was legal
+    if (bestValue == -INF && excludedMove.value != 0) {
+        return alpha;
+    }
+    if (storeResult) {
+        STATS(countStore(ttEntry, node.key));
+        storeTransposition(ttEntry, node.key, bestMove, scoreToTT(bestValue, plies), EVAL_NONE, depth,
+                           bestValue > alphaOriginal ? BOUND_EXACT : BOUND_UPPER);
+    }
+    if (plies == 0 && multiPVCount == 0) {
         globalBestMove.value = bestMove.value;
     }
 
@@ -153,135 +737,231 @@ int negamax(Position& node, int depth, int plies, int alpha, int beta) {
 
 
 int staticExchangeValue(Position& pos, const Move& move) {
-    int attackerValue[16] = {0};
-    int defenderValue[16] = {0};
-    int attackers = 0;
-    int defenders = 0;
+    // Attackers from least to most valuable, the king can only capture last
+    const int priority[14] = {PAWN, LANCE, KNIGHT, PROMOTED_PAWN, PROMOTED_KNIGHT, PROMOTED_LANCE, SILVER_GENERAL, PROMOTED_SILVER_GENERAL, GOLD_GENERAL, BISHOP, ROOK, PROMOTED_BISHOP, PROMOTED_ROOK, KING};
+    const int baseType[14] = {PAWN, LANCE, KNIGHT, PAWN, KNIGHT, LANCE, SILVER_GENERAL, SILVER_GENERAL, GOLD_GENERAL, BISHOP, ROOK, BISHOP, ROOK, KING};
 
     int captureSquare = move.to();
-    // attack is removed from occupied
-    const Bitboard occupied = (pos.pieceMaps[0] | pos.pieceMaps[1] | pos.pieceMaps[2] | pos.pieceMaps[3] |
-                               pos.pieceMaps[4] | pos.pieceMaps[5] | pos.pieceMaps[6] | pos.pieceMaps[7]) ^ squareMask[move.from()];
-    // We clear the squares around the capture square to a better sliding piece influence approximation.
-    // const Bitboard empty       = (~occupied & Bitboard(true)) | kingMask[captureSquare];
-    Bitboard empty       = ~occupied & Bitboard(true);
-    const Bitboard ownPieces   = (pos.playerOne ? pos.pieceMaps[8] : ~pos.pieceMaps[8]) & occupied;
-    const Bitboard enemyPieces = ~ownPieces & occupied;
-    const Bitboard promoted    = pos.pieceMaps[9];
-
-    Bitboard attackPieces, defencePieces;
-
-    /** build attack table **/
-    int priority[13] = {PAWN, LANCE, KNIGHT, PROMOTED_PAWN, PROMOTED_KNIGHT, PROMOTED_LANCE, SILVER_GENERAL, PROMOTED_SILVER_GENERAL, GOLD_GENERAL, BISHOP, ROOK, PROMOTED_BISHOP, PROMOTED_ROOK};
-    int baseType[13] = {PAWN, LANCE, KNIGHT, PAWN, KNIGHT, LANCE, SILVER_GENERAL, SILVER_GENERAL, GOLD_GENERAL, BISHOP, ROOK, BISHOP, ROOK};
-    for (int j = 0; j < 13; j++) {
-        attackPieces  = ownPieces   & pos.pieceMaps[baseType[j]] & (priority[j] > 7 ? promoted : ~promoted) &
-                        attackMap(priority[j], captureSquare, empty, !pos.playerOne);
-        defencePieces = enemyPieces & pos.pieceMaps[baseType[j]] & (priority[j] > 7 ? promoted : ~promoted) &
-                        attackMap(priority[j], captureSquare, empty, pos.playerOne);
-        int attackCount = attackPieces.count();
-        for (int i = 0; i < attackCount; i++) {
-            attackerValue[attackers] = captureValue[priority[j]];
-            attackers++;
-        }
-
-        int defenceCount = defencePieces.count();
-        for (int i = 0; i < defenceCount; i++) {
-            defenderValue[defenders] = captureValue[priority[j]];
-            defenders++;
-        }
-
-        empty |= attackPieces | defencePieces;
-    }
-
-    // compute SEE (could be optimized?)
-    int gain[32] = {0};
+    const Bitboard promoted      = pos.pieceMaps[9];
+    const Bitboard sidePieces[2] = {pos.sideOccupancy(false), pos.sideOccupancy(true)};
+    const Bitboard lances        = pos.pieceMaps[LANCE] & ~promoted;
+    // Vacating a square on these lines can uncover a slider behind it
+    const Bitboard rookLines     = rookAttack(captureSquare, Bitboard(true));
+    const Bitboard bishopLines   = bishopAttack(captureSquare, Bitboard(true));
+
+    Bitboard occupied  = pos.occupancy();
+    Bitboard attackers = pos.attackersTo(captureSquare, occupied);
+    // Drops originate from the out of bounds square, which has an empty mask
+    Bitboard fromSet   = squareMask[move.from()];
+    int pieceOnSquare  = move.movedPiece() + (move.isPromotion() ? 8 : 0);
+    bool side = pos.playerOne;
+
+    // Swap list, gain[i] is the score of the side that made the i-th capture
+    int gain[32];
+    int depth = 0;
     gain[0] = captureValue[move.capturedPiece()];
-    gain[1] = captureValue[move.movedPiece()] - gain[0];
-
-    int depth = 1, a = 0, d = 0;
-    bool side = false;
-    while ((side && a < attackers) || (!side && d < defenders)) {
+    do {
         depth++;
-        int nextPiece = side ? attackerValue[a++] : defenderValue[d++];
-        gain[depth] = nextPiece - gain[depth - 1];
+        // Speculative gain, only counted if the other side can recapture
+        gain[depth] = captureValue[pieceOnSquare] - gain[depth - 1];
+
+        occupied  ^= fromSet;
+        attackers &= occupied;
+        // Re-scan only the slider line through the vacated square
+        if (fromSet & rookLines) {
+            const Bitboard empty = ~occupied & Bitboard(true);
+            attackers |= ((rookAttack(captureSquare, empty) & pos.pieceMaps[ROOK]) |
+                          (lanceAttack(captureSquare, empty, false) & lances & sidePieces[true]) |
+                          (lanceAttack(captureSquare, empty, true) & lances & sidePieces[false])) & occupied;
+        }
+        else if (fromSet & bishopLines) {
+            const Bitboard empty = ~occupied & Bitboard(true);
+            attackers |= bishopAttack(captureSquare, empty) & pos.pieceMaps[BISHOP] & occupied;
+        }
+
+        // Least valuable attacker of the other side
         side = !side;
-    }
+        fromSet = Bitboard(false);
+        const Bitboard sideAttackers = attackers & sidePieces[side];
+        for (int j = 0; j < 14 && sideAttackers; j++) {
+            Bitboard candidates = sideAttackers & pos.pieceMaps[baseType[j]] & (priority[j] > 7 ? promoted : ~promoted);
+            if (candidates) {
+                // The king cannot capture a defended piece
+                if (priority[j] != KING || !(attackers & sidePieces[!side])) {
+                    fromSet = squareMask[candidates.BSF()];
+                    pieceOnSquare = priority[j];
+                }
+                break;
+            }
+        }
+    } while (fromSet);
 
     // Minimax backpropagation
     while (--depth > 0) {
         gain[depth - 1] = -std::max(-gain[depth - 1], gain[depth]);
     }
 
-
     return gain[0];
 }
 
 
 int quiescence(Position& node, int plies, int qsPlies, int alpha, int beta) {
-    if ((evaluations & 65535)== 0) {
+    if ((quiescence_count & 65535)== 0) {
         last_time = getTime();
-        if (last_time - start_time > max_time) {
+        if (budgetSpent()) {
             // Exceeded time limit  terminate search
-            return 0;
+            stopSearch = true;
+        }
+    }
+    if (stopSearch) {
+        return 0;
+    }
+    quiescence_count++;
+    STATS(stats.nodesPerPly[plies]++);
+    selDepth = std::max(selDepth, plies);
+
+    const Repetition repetition = node.repetition(plies);
+    if (repetition != REPETITION_NONE) {
+        STATS(stats.repetitions++);
+        return repetitionScore(repetition, plies);
+    }
+    if (alpha < 0 && node.upcomingRepetition(plies)) {
+        STATS(stats.upcomingRepetitions++);
+        alpha = 0;
+        if (alpha >= beta) {
+            return alpha;
         }
     }
-    evaluations++;
-    int stand_pat = 100 * evaluation(node);
-    if (!node.playerOne) {
-        stand_pat = -stand_pat;
+
+    // Transposition table, an entry of any depth is deep enough for the quiescence search
+    bool ttHit;
+    TTEntry* ttEntry = probeTransposition(node.key, ttHit);
+    STATS(stats.ttProbes++);
+    STATS(stats.ttHits += ttHit);
+    Move ttMove;
+    int staticEval = EVAL_NONE;
+    if (ttHit) {
+        const int ttScore = scoreFromTT(ttEntry->score, plies);
+        if (ttEntry->bound == BOUND_EXACT) {
+            STATS(stats.ttCutoffs++);
+            return ttScore;
+        }
+        if (ttEntry->bound == BOUND_LOWER && ttScore >= beta) {
+            STATS(stats.ttCutoffs++);
+            return beta;
+        }
+        if (ttEntry->bound == BOUND_UPPER && ttScore <= alpha) {
+            STATS(stats.ttCutoffs++);
+            return alpha;
+        }
+        ttMove = ttEntry->ttMove();
+        staticEval = ttEntry->eval;
     }
 
-    // Stand pat pruning
-    if (stand_pat >= beta) {
-        ply_sum += plies;
-        return beta;
+    const bool inCheck = node.inCheck();
+
+    // When in check every evasion is searched and standing pat is not an option
+    int stand_pat = -INF;
+    // A lazy evaluation only bounds the static evaluation and is not stored
+    bool lazy = false;
+    if (!inCheck) {
+        if (staticEval == EVAL_NONE) {
+            evaluations++;
+            if (networkActive()) {
+                staticEval = evaluateNNUE(node);
+            }
+            else {
+                // The window from player one's point of view
+                staticEval = (node.playerOne ? lazyEvaluate(node, alpha, beta, lazy)
+                                             : lazyEvaluate(node, -beta, -alpha, lazy));
+            }
+            STATS(stats.lazyHigh += lazy && (node.playerOne ? staticEval >= beta : -staticEval >= beta));
+            STATS(stats.lazyLow  += lazy && (node.playerOne ? staticEval <= alpha : -staticEval <= alpha));
+            if (!node.playerOne) {
+                staticEval = -staticEval;
+            }
+            staticEval = std::max(-MATE_BOUND + 1, std::min(MATE_BOUND - 1, staticEval));
+        }
+        stand_pat = staticEval;
+
+        // Stand pat pruning
+        if (stand_pat >= beta) {
+            STATS(stats.standPatCutoffs++);
+            STATS(countStore(ttEntry, node.key));
+            storeTransposition(ttEntry, node.key, Move(), scoreToTT(stand_pat, plies), lazy ? EVAL_NONE : staticEval, 0, BOUND_LOWER);
+            return beta;
+        }
+        if (stand_pat > alpha) {
+            alpha = stand_pat;
+        }
+        // Prevent needlessly deep searches
+        if (qsPlies > 6) return stand_pat;
     }
-    if (stand_pat > alpha) {
-        alpha = stand_pat;
+    else if (plies >= MAX_PLY - 1) {
+        return alpha;
     }
-    // Prevent needlessly deep searches
-    if (qsPlies > 6) return stand_pat;
     generateTacticalMoves(node, moveListStack[plies]);
 
-    // No tactical moves? Return static eval
+    // No tactical moves? Return static eval, or the mate score if the evasions ran out
     if (moveListStack[plies].size == 0) {
-        ply_sum += plies;
-        return stand_pat;
+        return inCheck ? std::max(alpha, std::min(beta, -INF + 100 + plies)) : stand_pat;
     }
 
     // order moves
     for (int i = 0; i < moveListStack[plies].size; i++)
     {
         Move move = moveListStack[plies].moveList[i];
-        int moveScore = 31 + MVV_LVA[move.capturedPiece()] - MVV_LVA[move.movedPiece()]
-                                                  + 10 * move.isPromotion() - 4 * move.isDrop();
-        moveListStack[plies].moveList[i].setScore(moveScore);
+        moveListStack[plies].scores[i] = move.value == ttMove.value ? (1 << 22) : captureScore(move) - 4 * move.isDrop();
     }
-    moveListStack[plies].sort();
-
+    moveListStack[plies].sortByScore();
 
 
+    const int alphaOriginal = alpha;
+    Move bestMove;
+    // Captures searched without a cutoff, delta and SEE pruned ones are left out of the capture history
+    Move capturesSearched[MAX_TRACKED_CAPTURES];
+    int captureCount = 0;
     for (int i = 0; i < moveListStack[plies].size; i++) {
         Move move = moveListStack[plies].getMove(i);
 
-        // Filter out bad captures
-        if (move.isCapture() && staticExchangeValue(node, move) < -captureValue[PAWN]) continue;
+        if (!inCheck && move.isCapture()) {
+            // Delta pruning, even winning the captured piece for free does not reach alpha
+            if (!move.isPromotion() && stand_pat + captureValue[move.capturedPiece()] + DELTA_MARGIN <= alpha) {
+                STATS(stats.deltaPrunes++);
+                continue;
+            }
+            // Filter out bad captures
+            if (staticExchangeValue(node, move) < -captureValue[PAWN]) {
+                STATS(stats.seePrunes++);
+                continue;
+            }
+        }
 
         node.makeMove(move);
         int score = -quiescence(node, plies + 1, qsPlies + 1, -beta, -alpha);
         node.undoMove(move);
 
+        if (stopSearch) {
+            return 0;
+        }
+
         if (score >= beta) {
-            ply_sum += plies;
+            updateCaptureHistories(move, capturesSearched, captureCount, historyBonus(100));
+            STATS(countStore(ttEntry, node.key));
+            storeTransposition(ttEntry, node.key, move, scoreToTT(beta, plies), inCheck || lazy ? EVAL_NONE : staticEval, 0, BOUND_LOWER);
             return beta;
         }
-        if (score > alpha) alpha = score;
+        if (move.isCapture() && captureCount < MAX_TRACKED_CAPTURES) {
+            capturesSearched[captureCount++] = move;
+        }
+        if (score > alpha) {
+            alpha = score;
+            bestMove.value = move.value & 0x00FFFFFF;
+        }
     }
 
+    STATS(countStore(ttEntry, node.key));
+    storeTransposition(ttEntry, node.key, bestMove, scoreToTT(alpha, plies), inCheck || lazy ? EVAL_NONE : staticEval, 0,
+                       alpha > alphaOriginal ? BOUND_EXACT : BOUND_UPPER);
     return alpha;
 }
-
-
-
-
@@ -1,6 +1,26 @@
 #ifndef SEARCH_H_INCLUDED
 #define SEARCH_H_INCLUDED
 
+#include <atomic>
+
+// Limits of a search, zero means no limit
+struct SearchLimits {
+    int time = 0;        // milliseconds the move should take, stretched or cut short by the best move stability
+    int maxTime = 0;     // milliseconds
+    int depth = 0;       // plies
+    uint64_t nodes = 0;
+};
+
+// Number of principal variations searched and reported
+extern int multiPV;
+// Set to end the search, pondering suspends the limits until the ponderhit
+extern std::atomic<bool> stopSearch;
+extern std::atomic<bool> pondering;
+extern std::atomic<int> start_time;
+
+void clearSearchHistory();
+uint64_t searchedNodes();
+Move think(Position& pos, const SearchLimits& limits, Move& ponderMove);
 void engineMove (Position& pos, int timeAllowance);
 int staticExchangeValue(Position& pos, const Move& move);
 #endif // SEARCH_H_INCLUDED
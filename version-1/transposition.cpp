@@ -0,0 +1,118 @@
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include "transposition.h"
+
+const int CLUSTER_SIZE = 4;
+
+struct alignas(64) TTCluster
+{
+    TTEntry entry[CLUSTER_SIZE];
+};
+
+std::vector<TTCluster> table;
+uint64_t clusterMask = 0;
+uint8_t currentGeneration = 0;
+
+void resizeTranspositionTable(int megabytes)
+{
+    // Round down to a power of two number of clusters so the index is a mask
+    uint64_t clusters = 1;
+    while (2 * clusters * sizeof(TTCluster) <= (uint64_t) megabytes * 1024 * 1024)
+    {
+        clusters *= 2;
+    }
+    table.assign(clusters, TTCluster());
+    clusterMask = clusters - 1;
+    clearTranspositionTable();
+}
+
+void clearTranspositionTable()
+{
+    for (TTCluster& cluster : table)
+    {
+        for (TTEntry& entry : cluster.entry)
+        {
+            entry = TTEntry();
+            entry.eval = EVAL_NONE;
+        }
+    }
+    currentGeneration = 0;
+}
+
+void newSearchGeneration()
+{
+    if (table.empty())
+    {
+        resizeTranspositionTable(16);
+    }
+    currentGeneration++;
+}
+
+// Returns the entry of the position if found, otherwise the entry that should be replaced.
+TTEntry* probeTransposition(uint64_t key, bool& found)
+{
+    TTEntry* cluster = table[key & clusterMask].entry;
+    const uint32_t key32 = key >> 32;
+    for (int i = 0; i < CLUSTER_SIZE; i++)
+    {
+        if (cluster[i].key32 == key32 && cluster[i].bound != BOUND_NONE)
+        {
+            found = true;
+            return &cluster[i];
+        }
+    }
+    // Replace the shallowest entry, where older searches count as shallower
+    found = false;
+    TTEntry* replace = &cluster[0];
+    for (int i = 1; i < CLUSTER_SIZE; i++)
+    {
+        if (cluster[i].depth - 800 * (uint8_t) (currentGeneration - cluster[i].generation) <
+            replace->depth - 800 * (uint8_t) (currentGeneration - replace->generation))
+        {
+            replace = &cluster[i];
+        }
+    }
+    return replace;
+}
+
+// Permille of a sample of entries that were written during the current search
+int hashfull()
+{
+    const uint64_t clusters = std::min<uint64_t>(250, table.size());
+    int used = 0;
+    for (uint64_t i = 0; i < clusters; i++)
+    {
+        for (const TTEntry& entry : table[i].entry)
+        {
+            used += entry.bound != BOUND_NONE && entry.generation == currentGeneration;
+        }
+    }
+    return clusters ? used * 1000 / (clusters * CLUSTER_SIZE) : 0;
+}
+
+void storeTransposition(TTEntry* entry, uint64_t key, const Move& move, int score, int eval, int depth, Bound bound)
+{
+    const uint32_t key32 = key >> 32;
+    const bool samePosition = entry->key32 == key32 && entry->bound != BOUND_NONE;
+    // Keep the old move when the position has been searched without finding one
+    if (move.value != 0 || !samePosition)
+    {
+        entry->move = move.value;
+    }
+    // Keep the static evaluation of a search that did not compute one
+    if (eval != EVAL_NONE || !samePosition)
+    {
+        entry->eval = (int16_t) eval;
+    }
+    // A bound from a much shallower search is worth less than the result already stored
+    if (samePosition && bound != BOUND_EXACT && depth + 400 < entry->depth)
+    {
+        return;
+    }
+    entry->key32      = key32;
+    entry->score      = (int16_t) score;
+    entry->depth      = (int16_t) depth;
+    entry->bound      = bound;
+    entry->generation = currentGeneration;
+}
@@ -0,0 +1,43 @@
+#ifndef TRANSPOSITION_H_INCLUDED
+#define TRANSPOSITION_H_INCLUDED
+
+#include "position.h"
+
+enum Bound : uint8_t
+{
+    BOUND_NONE  = 0,
+    BOUND_UPPER = 1,
+    BOUND_LOWER = 2,
+    BOUND_EXACT = BOUND_UPPER | BOUND_LOWER
+};
+
+// Marks an entry without a static evaluation
+const int EVAL_NONE = -32768;
+
+// 16 bytes, four entries share a cache line
+struct TTEntry
+{
+    uint32_t key32;
+    int32_t  move;
+    int16_t  score;
+    int16_t  eval;
+    int16_t  depth;
+    uint8_t  bound;
+    uint8_t  generation;
+
+    Move ttMove() const
+    {
+        Move result;
+        result.value = move;
+        return result;
+    }
+};
+
+void resizeTranspositionTable(int megabytes);
+void clearTranspositionTable();
+void newSearchGeneration();
+TTEntry* probeTransposition(uint64_t key, bool& found);
+int hashfull();
+void storeTransposition(TTEntry* entry, uint64_t key, const Move& move, int score, int eval, int depth, Bound bound);
+
+#endif // TRANSPOSITION_H_INCLUDED
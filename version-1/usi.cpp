@@ -0,0 +1,242 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+#include "moveGenerator.h"
+#include "position.h"
+#include "random.h"
+#include "search.h"
+#include "transposition.h"
+#include "usi.h"
+#include "bench.h"
+
+// Time kept back for communication with the GUI
+const int MOVE_OVERHEAD = 50;
+
+Position root;
+std::string evalFile = "nn.bin";
+std::thread searchThread;
+// go infinite and go ponder may only report their move after stop or ponderhit
+std::atomic<bool> waitForStop(false);
+
+// Ends a running search, the tables it reads may only change after this
+void stopThinking()
+{
+    stopSearch = true;
+    waitForStop = false;
+    if (searchThread.joinable())
+    {
+        searchThread.join();
+    }
+}
+
+void setPosition(std::istringstream& is)
+{
+    std::string token;
+    is >> token;
+    if (token == "startpos")
+    {
+        root.loadInitial();
+        is >> token;
+    }
+    else if (token == "sfen")
+    {
+        std::string sfen;
+        while (is >> token && token != "moves")
+        {
+            sfen += token + " ";
+        }
+        root.loadSFEN(sfen.c_str());
+    }
+    while (is >> token)
+    {
+        Move move = root.USIToMove(token.c_str());
+        root.makeMove(move);
+    }
+}
+
+// Loads the network when it is selected and switches the evaluator, falling back to evaluate() without a network
+void selectEvaluator()
+{
+    stopThinking();
+    if (useNNUE && !loadNetwork(evalFile))
+    {
+        std::cout << "info string Failed to load network " << evalFile << std::endl;
+        useNNUE = false;
+    }
+    // Stored evaluations belong to the previous evaluator
+    clearTranspositionTable();
+    initialiseAccumulators(root);
+}
+
+void setOption(std::istringstream& is)
+{
+    std::string token, name, value;
+    is >> token;
+    while (is >> token && token != "value")
+    {
+        name += (name.empty() ? "" : " ") + token;
+    }
+    is >> value;
+    if (name == "USI_Hash")
+    {
+        stopThinking();
+        resizeTranspositionTable(std::max(1, std::stoi(value)));
+    }
+    else if (name == "MultiPV")
+    {
+        multiPV = std::max(1, std::stoi(value));
+    }
+    else if (name == "UseNNUE")
+    {
+        useNNUE = (value == "true");
+        selectEvaluator();
+    }
+    else if (name == "EvalFile")
+    {
+        evalFile = value;
+        if (useNNUE)
+        {
+            selectEvaluator();
+        }
+    }
+}
+
+// Reads the limits and starts searching on a copy of the root in the background
+void go(std::istringstream& is)
+{
+    SearchLimits limits;
+    int remaining[2] = {0, 0};
+    int increment[2] = {0, 0};
+    int byoyomi = 0;
+    int moveTime = 0;
+    bool infinite = false;
+    bool ponder = false;
+    std::string token;
+    while (is >> token)
+    {
+        if (token == "btime")      is >> remaining[1];
+        else if (token == "wtime") is >> remaining[0];
+        else if (token == "binc")  is >> increment[1];
+        else if (token == "winc")  is >> increment[0];
+        else if (token == "byoyomi")  is >> byoyomi;
+        else if (token == "movetime") is >> moveTime;
+        else if (token == "depth")    is >> limits.depth;
+        else if (token == "nodes")    is >> limits.nodes;
+        else if (token == "infinite") infinite = true;
+        else if (token == "ponder")   ponder = true;
+    }
+
+    // Spend a fraction of the remaining time, but never more than is left on the clock
+    const int own = remaining[root.playerOne];
+    if (moveTime != 0)
+    {
+        // A fixed time is used in full, the stability scaling only applies to a planned time
+        limits.maxTime = std::max(1, moveTime - MOVE_OVERHEAD);
+    }
+    else if (!infinite && (own != 0 || byoyomi != 0))
+    {
+        limits.maxTime = std::max(1, own + byoyomi - MOVE_OVERHEAD);
+        limits.time    = std::min(limits.maxTime, own / 30 + increment[root.playerOne] + byoyomi);
+        limits.maxTime = std::min(limits.maxTime, 4 * limits.time);
+    }
+
+    stopSearch  = false;
+    pondering   = ponder;
+    waitForStop = ponder || infinite;
+    searchThread = std::thread([limits]()
+    {
+        Position pos = root;
+        Move ponderMove;
+        Move bestMove = think(pos, limits, ponderMove);
+        while (waitForStop && !stopSearch)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (bestMove.value == 0)
+        {
+            std::cout << "bestmove resign" << std::endl;
+        }
+        else if (ponderMove.value == 0)
+        {
+            std::cout << "bestmove " << bestMove << std::endl;
+        }
+        else
+        {
+            std::cout << "bestmove " << bestMove << " ponder " << ponderMove << std::endl;
+        }
+    });
+}
+
+void usiLoop()
+{
+    root.loadInitial();
+    std::string line, token;
+    while (std::getline(std::cin, line))
+    {
+        std::istringstream is(line);
+        token.clear();
+        is >> token;
+        if (token == "usi")
+        {
+            std::cout << "id name samurai\n"
+                      << "id author daannoordenbos\n"
+                      << "option name USI_Hash type spin default 16 min 1 max 4096\n"
+                      << "option name USI_Ponder type check default false\n"
+                      << "option name MultiPV type spin default 1 min 1 max 64\n"
+                      << "option name UseNNUE type check default false\n"
+                      << "option name EvalFile type string default nn.bin\n"
+                      << "usiok" << std::endl;
+        }
+        else if (token == "isready")
+        {
+            std::cout << "readyok" << std::endl;
+        }
+        else if (token == "setoption")
+        {
+            setOption(is);
+        }
+        else if (token == "usinewgame")
+        {
+            stopThinking();
+            clearTranspositionTable();
+            clearSearchHistory();
+        }
+        else if (token == "position")
+        {
+            stopThinking();
+            setPosition(is);
+        }
+        else if (token == "go")
+        {
+            stopThinking();
+            go(is);
+        }
+        else if (token == "stop")
+        {
+            stopThinking();
+        }
+        else if (token == "ponderhit")
+        {
+            // The expected reply was played, the move is now timed from here
+            start_time = getTime();
+            pondering = false;
+            waitForStop = false;
+        }
+        else if (token == "bench")
+        {
+            stopThinking();
+            int depth = BENCH_DEPTH;
+            is >> depth;
+            bench(depth);
+        }
+        else if (token == "quit")
+        {
+            break;
+        }
+    }
+    stopThinking();
+}
@@ -0,0 +1,6 @@
+#ifndef USI_H_INCLUDED
+#define USI_H_INCLUDED
+
+void usiLoop();
+
+#endif // USI_H_INCLUDED